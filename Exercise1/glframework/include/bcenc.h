@@ -0,0 +1,265 @@
+#ifndef BCENC_H
+#define BCENC_H
+
+#include <stddef.h>
+
+// Block compression of RGBA8 images into BC1 (DXT1, opaque rgb) and BC3
+// (DXT5, rgb with interpolated alpha). Images are split into 4x4 blocks in
+// row major order, partial blocks at the right and bottom border repeat the
+// last column/row.
+//
+// Endpoints are the inset bounding box of the block colors, with the box
+// diagonal chosen by the sign of the color covariance. This is the fast
+// encoder from "Real-Time DXT Compression" (J.M.P. van Waveren), it trades
+// some quality for speed compared to iterative encoders.
+
+enum bcFormat
+{
+	bcFormatBC1, // 8 bytes per block
+	bcFormatBC3  // 16 bytes per block
+};
+
+size_t bcCompressedSize(int width, int height, bcFormat format);
+
+// Runs work(item, context) for the items 0 to count - 1 on any threads and
+// returns once all of them are done, e.g. on the worker threads of the caller.
+typedef void (*bcParallelFor)(size_t count, void (*work)(size_t item, void * context), void * context);
+
+// Compresses the image into blocks, which must hold bcCompressedSize bytes.
+// Block rows are split into threadCount bands, 0 uses all hardware threads.
+// The bands run through parallelFor if given, otherwise on threads of their own.
+void bcCompressImage(
+	const unsigned char * rgba,
+	int width,
+	int height,
+	bcFormat format,
+	unsigned char * blocks,
+	unsigned int threadCount = 1,
+	bcParallelFor parallelFor = NULL
+);
+
+#if defined(BCENC_IMPLEMENTATION)
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BCENC_SSE2
+#endif
+
+size_t bcCompressedSize(int width, int height, bcFormat format)
+{
+	size_t blocks = (size_t)((width + 3) / 4) * ((height + 3) / 4);
+	return blocks * (format == bcFormatBC1 ? 8 : 16);
+}
+
+// Copies the 4x4 block at (bx, by) into 64 bytes, clamping at the image border.
+static inline void bcExtractBlock(const unsigned char * rgba, int width, int height, int bx, int by, unsigned char * block)
+{
+	for (int y = 0; y < 4; ++y){
+		const unsigned char * row = rgba + (size_t)std::min(by * 4 + y, height - 1) * width * 4;
+		if (bx * 4 + 4 <= width){
+			memcpy(block + y * 16, row + bx * 16, 16);
+		} else {
+			for (int x = 0; x < 4; ++x)
+				memcpy(block + y * 16 + x * 4, row + std::min(bx * 4 + x, width - 1) * 4, 4);
+		}
+	}
+}
+
+// Per channel minimum and maximum of the 16 texels.
+static inline void bcBlockBounds(const unsigned char * block, unsigned char * minColor, unsigned char * maxColor)
+{
+#if defined(BCENC_SSE2)
+	__m128i row0 = _mm_loadu_si128((const __m128i*)block);
+	__m128i row1 = _mm_loadu_si128((const __m128i*)(block + 16));
+	__m128i row2 = _mm_loadu_si128((const __m128i*)(block + 32));
+	__m128i row3 = _mm_loadu_si128((const __m128i*)(block + 48));
+	__m128i lo = _mm_min_epu8(_mm_min_epu8(row0, row1), _mm_min_epu8(row2, row3));
+	__m128i hi = _mm_max_epu8(_mm_max_epu8(row0, row1), _mm_max_epu8(row2, row3));
+	lo = _mm_min_epu8(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(1, 0, 3, 2)));
+	hi = _mm_max_epu8(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(1, 0, 3, 2)));
+	lo = _mm_min_epu8(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+	hi = _mm_max_epu8(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 3, 0, 1)));
+	int packedMin = _mm_cvtsi128_si32(lo);
+	int packedMax = _mm_cvtsi128_si32(hi);
+	memcpy(minColor, &packedMin, 4);
+	memcpy(maxColor, &packedMax, 4);
+#else
+	memcpy(minColor, block, 4);
+	memcpy(maxColor, block, 4);
+	for (int i = 1; i < 16; ++i){
+		for (int c = 0; c < 4; ++c){
+			minColor[c] = std::min(minColor[c], block[i * 4 + c]);
+			maxColor[c] = std::max(maxColor[c], block[i * 4 + c]);
+		}
+	}
+#endif
+}
+
+static inline unsigned short bcPack565(const int * color)
+{
+	return (unsigned short)(((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) | (color[2] >> 3));
+}
+
+static inline void bcUnpack565(unsigned short packed, int * color)
+{
+	int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+static void bcEncodeColor(const unsigned char * block, const unsigned char * minColor, const unsigned char * maxColor, unsigned char * out)
+{
+	int lo[3], hi[3], center[3];
+	for (int c = 0; c < 3; ++c){
+		center[c] = (minColor[c] + maxColor[c] + 1) / 2;
+		lo[c] = minColor[c];
+		hi[c] = maxColor[c];
+	}
+
+	// the bounding box diagonal follows the covariance of red and blue with green
+	int covarianceRG = 0, covarianceBG = 0;
+	for (int i = 0; i < 16; ++i){
+		int g = block[i * 4 + 1] - center[1];
+		covarianceRG += (block[i * 4 + 0] - center[0]) * g;
+		covarianceBG += (block[i * 4 + 2] - center[2]) * g;
+	}
+	if (covarianceRG < 0) std::swap(lo[0], hi[0]);
+	if (covarianceBG < 0) std::swap(lo[2], hi[2]);
+
+	// inset the box by 1/16 to reduce the error of the interpolated colors
+	for (int c = 0; c < 3; ++c){
+		int inset = (hi[c] - lo[c]) / 16;
+		lo[c] = std::min(255, std::max(0, lo[c] + inset));
+		hi[c] = std::min(255, std::max(0, hi[c] - inset));
+	}
+
+	unsigned short color0 = bcPack565(hi), color1 = bcPack565(lo);
+	unsigned int indices = 0;
+	if (color0 != color1){
+		// four color mode requires color0 > color1
+		if (color0 < color1)
+			std::swap(color0, color1);
+		int palette[4][3];
+		bcUnpack565(color0, palette[0]);
+		bcUnpack565(color1, palette[1]);
+		for (int c = 0; c < 3; ++c){
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		for (int i = 0; i < 16; ++i){
+			int best = 0, bestDistance = 1 << 30;
+			for (int p = 0; p < 4; ++p){
+				int dr = block[i * 4 + 0] - palette[p][0];
+				int dg = block[i * 4 + 1] - palette[p][1];
+				int db = block[i * 4 + 2] - palette[p][2];
+				int distance = dr * dr + dg * dg + db * db;
+				if (distance < bestDistance){
+					bestDistance = distance;
+					best = p;
+				}
+			}
+			indices |= (unsigned int)best << (i * 2);
+		}
+	}
+
+	out[0] = (unsigned char)(color0 & 0xff);
+	out[1] = (unsigned char)(color0 >> 8);
+	out[2] = (unsigned char)(color1 & 0xff);
+	out[3] = (unsigned char)(color1 >> 8);
+	for (int i = 0; i < 4; ++i)
+		out[4 + i] = (unsigned char)(indices >> (i * 8));
+}
+
+static void bcEncodeAlpha(const unsigned char * block, int minAlpha, int maxAlpha, unsigned char * out)
+{
+	// eight alpha mode: index 0 is maxAlpha, 1 is minAlpha, 2 to 7 interpolate from max to min
+	unsigned long long indices = 0;
+	int range = maxAlpha - minAlpha;
+	if (range > 0){
+		for (int i = 0; i < 16; ++i){
+			int step = ((block[i * 4 + 3] - minAlpha) * 7 + range / 2) / range;
+			int index = step == 7 ? 0 : step == 0 ? 1 : 8 - step;
+			indices |= (unsigned long long)index << (i * 3);
+		}
+	}
+	out[0] = (unsigned char)maxAlpha;
+	out[1] = (unsigned char)minAlpha;
+	for (int i = 0; i < 6; ++i)
+		out[2 + i] = (unsigned char)(indices >> (i * 8));
+}
+
+static void bcCompressRows(const unsigned char * rgba, int width, int height, bcFormat format, unsigned char * blocks, int firstRow, int lastRow)
+{
+	const int blocksPerRow = (width + 3) / 4;
+	const size_t blockSize = format == bcFormatBC1 ? 8 : 16;
+	unsigned char block[64], minColor[4], maxColor[4];
+	for (int by = firstRow; by < lastRow; ++by){
+		for (int bx = 0; bx < blocksPerRow; ++bx){
+			unsigned char * out = blocks + ((size_t)by * blocksPerRow + bx) * blockSize;
+			bcExtractBlock(rgba, width, height, bx, by, block);
+			bcBlockBounds(block, minColor, maxColor);
+			if (format == bcFormatBC3){
+				bcEncodeAlpha(block, minColor[3], maxColor[3], out);
+				out += 8;
+			}
+			bcEncodeColor(block, minColor, maxColor, out);
+		}
+	}
+}
+
+// the image split into bands of block rows
+struct bcBands
+{
+	const unsigned char * rgba;
+	int width;
+	int height;
+	bcFormat format;
+	unsigned char * blocks;
+	int rows;
+	unsigned int count;
+};
+
+static void bcCompressBand(size_t band, void * context)
+{
+	const bcBands & bands = *(const bcBands*)context;
+	bcCompressRows(bands.rgba, bands.width, bands.height, bands.format, bands.blocks,
+		(int)((size_t)bands.rows * band / bands.count), (int)((size_t)bands.rows * (band + 1) / bands.count));
+}
+
+void bcCompressImage(
+	const unsigned char * rgba,
+	int width,
+	int height,
+	bcFormat format,
+	unsigned char * blocks,
+	unsigned int threadCount,
+	bcParallelFor parallelFor
+){
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	const int rows = (height + 3) / 4;
+	const size_t blockCount = (size_t)rows * ((width + 3) / 4);
+	bcBands bands = { rgba, width, height, format, blocks, rows, 0 };
+	bands.count = (unsigned int)std::min<size_t>(std::min<size_t>(threadCount, rows), blockCount / 1024 + 1);
+
+	if (parallelFor && bands.count > 1){
+		parallelFor(bands.count, bcCompressBand, &bands);
+		return;
+	}
+	std::vector<std::thread> threads;
+	for (unsigned int band = 1; band < bands.count; ++band)
+		threads.push_back(std::thread(bcCompressBand, band, &bands));
+	bcCompressBand(0, &bands);
+	for (size_t t = 0; t < threads.size(); ++t)
+		threads[t].join();
+}
+
+#endif
+
+#endif
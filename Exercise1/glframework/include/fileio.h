@@ -0,0 +1,258 @@
+#ifndef FILEIO_H
+#define FILEIO_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// File access shared by the shader, image and mesh loaders. A file is either
+// memory mapped, which needs no copy at all, or read with a single copy into
+// memory owned by a fileArena. Nothing returned by these functions has to be
+// freed individually: mappings end with fileUnmap, arena memory with
+// fileArenaRelease.
+
+// Read only view of a whole file. A zero initialized mapping is empty and may
+// be passed to fileUnmap, as may a mapping whose fileMap failed.
+struct fileMapping
+{
+	const char * data;
+	size_t size;
+#if defined(_WIN32)
+	void * file;
+	void * mapping;
+#endif
+};
+
+bool fileMap(const char * path, fileMapping & mapping);
+void fileUnmap(fileMapping & mapping);
+
+// Drops the mapped pages in [begin, end) from the resident set. They are
+// clean file pages, so the kernel can reload them if they are touched again.
+void fileReleasePages(const fileMapping & mapping, const char * begin, const char * end);
+
+// Bump allocator for loaded files, zero initialize before the first use.
+struct fileArena
+{
+	char * block;     // current block, starts with a pointer to the previous block
+	size_t used;
+	size_t capacity;
+};
+
+// Returns 16 byte aligned memory that stays valid until the arena is released.
+void * fileArenaAllocate(fileArena & arena, size_t size);
+void fileArenaRelease(fileArena & arena);
+
+// Reads the whole file into the arena and appends a terminating zero, which is
+// not counted in size.
+bool fileRead(const char * path, fileArena & arena, const char ** data, size_t * size);
+
+// Replaces a file as a whole. fileCreateTemporary opens a uniquely named file
+// next to path for writing, fileCommitTemporary closes it and renames it over
+// path if complete is true, or deletes it otherwise. Readers that open or map
+// path at the same time see the previous file or the new one, never a partial
+// one. temporaryPath needs room for strlen(path) + fileTemporarySuffixSize
+// characters.
+static const size_t fileTemporarySuffixSize = 48;
+FILE * fileCreateTemporary(const char * path, char * temporaryPath);
+bool fileCommitTemporary(FILE * file, const char * temporaryPath, const char * path, bool complete);
+
+#if defined(FILEIO_IMPLEMENTATION)
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//
+// Memory mapped files
+//
+
+bool fileMap(const char * path, fileMapping & mapping)
+{
+	mapping.data = NULL;
+	mapping.size = 0;
+#if defined(_WIN32)
+	// a failed mapping holds no handles, so fileUnmap is safe after any result
+	mapping.file = INVALID_HANDLE_VALUE;
+	mapping.mapping = NULL;
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)){
+		CloseHandle(file);
+		return false;
+	}
+	mapping.file = file;
+	mapping.size = (size_t)size.QuadPart;
+	if (mapping.size == 0)
+		return true; // empty files can't be mapped, but they are valid
+	mapping.mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping.mapping)
+		mapping.data = (const char*)MapViewOfFile((HANDLE)mapping.mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!mapping.data){
+		if (mapping.mapping) CloseHandle((HANDLE)mapping.mapping);
+		CloseHandle(file);
+		mapping.file = INVALID_HANDLE_VALUE;
+		mapping.mapping = NULL;
+		mapping.size = 0;
+		return false;
+	}
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat info;
+	if (fstat(fd, &info) != 0){
+		close(fd);
+		return false;
+	}
+	mapping.size = (size_t)info.st_size;
+	if (mapping.size > 0){
+		void* data = mmap(NULL, mapping.size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED){
+			close(fd);
+			return false;
+		}
+		madvise(data, mapping.size, MADV_SEQUENTIAL);
+		mapping.data = (const char*)data;
+	}
+	close(fd); // the mapping keeps its own reference to the file
+#endif
+	return true;
+}
+
+void fileUnmap(fileMapping & mapping)
+{
+#if defined(_WIN32)
+	if (mapping.data) UnmapViewOfFile(mapping.data);
+	if (mapping.mapping) CloseHandle((HANDLE)mapping.mapping);
+	if (mapping.file && mapping.file != INVALID_HANDLE_VALUE) CloseHandle((HANDLE)mapping.file);
+	mapping.file = INVALID_HANDLE_VALUE;
+	mapping.mapping = NULL;
+#else
+	if (mapping.data) munmap((void*)mapping.data, mapping.size);
+#endif
+	mapping.data = NULL;
+	mapping.size = 0;
+}
+
+void fileReleasePages(const fileMapping & mapping, const char * begin, const char * end)
+{
+#if !defined(_WIN32)
+	const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	size_t first = ((size_t)(begin - mapping.data) + pageSize - 1) / pageSize * pageSize;
+	size_t last = (size_t)(end - mapping.data) / pageSize * pageSize;
+	if (last > first)
+		madvise((void*)(mapping.data + first), last - first, MADV_DONTNEED);
+#else
+	(void)mapping; (void)begin; (void)end;
+#endif
+}
+
+//
+// Arena
+//
+
+static const size_t fileArenaHeader = 16;       // previous block pointer, padded for alignment
+static const size_t fileArenaBlockSize = 65536;
+
+void * fileArenaAllocate(fileArena & arena, size_t size)
+{
+	size = (size + 15) & ~(size_t)15;
+	if (!arena.block || arena.used + size > arena.capacity){
+		// large requests get a block of their own
+		size_t capacity = std::max(fileArenaBlockSize, fileArenaHeader + size);
+		char* block = (char*)malloc(capacity);
+		if (!block)
+			return NULL;
+		*(char**)block = arena.block;
+		arena.block = block;
+		arena.used = fileArenaHeader;
+		arena.capacity = capacity;
+	}
+	void* memory = arena.block + arena.used;
+	arena.used += size;
+	return memory;
+}
+
+void fileArenaRelease(fileArena & arena)
+{
+	while (arena.block){
+		char* previous = *(char**)arena.block;
+		free(arena.block);
+		arena.block = previous;
+	}
+	arena.used = 0;
+	arena.capacity = 0;
+}
+
+bool fileRead(const char * path, fileArena & arena, const char ** data, size_t * size)
+{
+	*data = NULL;
+	*size = 0;
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return false;
+	bool res = fseek(file, 0, SEEK_END) == 0;
+	long length = res ? ftell(file) : -1;
+	res = length >= 0 && fseek(file, 0, SEEK_SET) == 0;
+	char* buffer = res ? (char*)fileArenaAllocate(arena, (size_t)length + 1) : NULL;
+	res = buffer && fread(buffer, 1, (size_t)length, file) == (size_t)length;
+	fclose(file);
+	if (!res)
+		return false;
+	buffer[length] = 0;
+	*data = buffer;
+	*size = (size_t)length;
+	return true;
+}
+
+//
+// Replacing files
+//
+
+FILE * fileCreateTemporary(const char * path, char * temporaryPath)
+{
+	// the process and a counter keep writers in other processes and threads apart
+	static std::atomic<unsigned int> counter(0);
+#if defined(_WIN32)
+	unsigned long process = (unsigned long)GetCurrentProcessId();
+#else
+	unsigned long process = (unsigned long)getpid();
+#endif
+	snprintf(temporaryPath, strlen(path) + fileTemporarySuffixSize, "%s.%lu.%u.tmp", path, process, counter++);
+	return fopen(temporaryPath, "wb");
+}
+
+bool fileCommitTemporary(FILE * file, const char * temporaryPath, const char * path, bool complete)
+{
+	complete = fclose(file) == 0 && complete;
+#if defined(_WIN32)
+	// fails while path is open or mapped, the previous file then stays in place
+	complete = complete && MoveFileExA(temporaryPath, path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	complete = complete && rename(temporaryPath, path) == 0;
+#endif
+	if (!complete)
+		remove(temporaryPath);
+	return complete;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,432 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <stddef.h>
+
+// CPU mip chain generation for tightly packed RGBA8 images.
+// A chain stores all levels one after another, level i has the size
+// max(1, width >> i) x max(1, height >> i) like the levels created by
+// glGenerateMipmap.
+
+enum mipColorSpace
+{
+	mipColorLinear, // all channels are filtered as stored
+	mipColorSRGB    // rgb is converted to linear light for filtering, alpha is linear
+};
+
+int mipLevelCount(int width, int height);
+size_t mipLevelSize(int width, int height, int level);
+size_t mipChainSize(int width, int height);
+
+// Runs work(item, context) for the items 0 to count - 1 on any threads and
+// returns once all of them are done, e.g. on the worker threads of the caller.
+typedef void (*mipParallelFor)(size_t count, void (*work)(size_t item, void * context), void * context);
+
+// Fills levels 1 to mipLevelCount - 1 of the chain, level 0 is expected at the start of chain.
+// Rows of larger levels are split into threadCount bands, 0 uses all hardware threads. The
+// bands run through parallelFor if given, otherwise on threads started for each level.
+void buildMipChain(
+	unsigned char * chain,
+	int width,
+	int height,
+	mipColorSpace colorSpace = mipColorLinear,
+	unsigned int threadCount = 1,
+	mipParallelFor parallelFor = NULL
+);
+
+// Scalar implementation of a single downsampling step, used where no SIMD path
+// applies and as reference for the SIMD paths.
+void mipDownsampleReference(
+	const unsigned char * source,
+	int sourceWidth,
+	int sourceHeight,
+	unsigned char * destination,
+	mipColorSpace colorSpace
+);
+
+#if defined(MIPMAP_IMPLEMENTATION)
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MIPMAP_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIPMAP_SSE2
+#endif
+
+int mipLevelCount(int width, int height)
+{
+	int levels = 1;
+	while (width > 1 || height > 1){
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+		++levels;
+	}
+	return levels;
+}
+
+size_t mipLevelSize(int width, int height, int level)
+{
+	return (size_t)std::max(1, width >> level) * std::max(1, height >> level) * 4;
+}
+
+size_t mipChainSize(int width, int height)
+{
+	size_t size = 0;
+	for (int level = 0; level < mipLevelCount(width, height); ++level)
+		size += mipLevelSize(width, height, level);
+	return size;
+}
+
+//
+// sRGB conversion tables
+//
+
+struct mipSRGBTables
+{
+	float toLinear[256];
+	unsigned char fromLinear[4096]; // indexed by linear value * 4095
+
+	mipSRGBTables()
+	{
+		for (int i = 0; i < 256; ++i){
+			float c = i / 255.0f;
+			toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+		}
+		for (int i = 0; i < 4096; ++i){
+			float l = i / 4095.0f;
+			float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+			fromLinear[i] = (unsigned char)(c * 255.0f + 0.5f);
+		}
+	}
+};
+
+static const mipSRGBTables & mipGetSRGBTables()
+{
+	static const mipSRGBTables tables;
+	return tables;
+}
+
+//
+// Scalar reference
+//
+
+// Source taps of one destination texel along an axis. Even sizes average two
+// texels, odd sizes use the three texel polyphase box filter, so every source
+// texel contributes exactly the same total weight.
+struct mipTaps
+{
+	int first;
+	int count;
+	float weights[3];
+};
+
+static inline mipTaps mipComputeTaps(int destination, int sourceSize)
+{
+	mipTaps taps;
+	taps.first = std::min(2 * destination, sourceSize - 1);
+	if (sourceSize == 1){
+		taps.count = 1;
+		taps.weights[0] = 1.0f;
+	} else if (sourceSize % 2 == 0){
+		taps.count = 2;
+		taps.weights[0] = taps.weights[1] = 0.5f;
+	} else {
+		int size = sourceSize / 2;
+		taps.count = 3;
+		taps.weights[0] = (float)(size - destination) / sourceSize;
+		taps.weights[1] = (float)size / sourceSize;
+		taps.weights[2] = (float)(destination + 1) / sourceSize;
+	}
+	return taps;
+}
+
+static void mipDownsampleRowsReference(
+	const unsigned char * source, int sourceWidth, int sourceHeight,
+	unsigned char * destination, int firstRow, int lastRow, mipColorSpace colorSpace
+){
+	const mipSRGBTables & srgb = mipGetSRGBTables();
+	const int width = std::max(1, sourceWidth / 2);
+	for (int y = firstRow; y < lastRow; ++y){
+		mipTaps rows = mipComputeTaps(y, sourceHeight);
+		unsigned char * out = destination + (size_t)y * width * 4;
+		for (int x = 0; x < width; ++x){
+			mipTaps columns = mipComputeTaps(x, sourceWidth);
+			float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for (int j = 0; j < rows.count; ++j){
+				const unsigned char * row = source + (size_t)(rows.first + j) * sourceWidth * 4;
+				for (int i = 0; i < columns.count; ++i){
+					const unsigned char * texel = row + (size_t)(columns.first + i) * 4;
+					float weight = rows.weights[j] * columns.weights[i];
+					for (int c = 0; c < 4; ++c){
+						float value = colorSpace == mipColorSRGB && c < 3 ? srgb.toLinear[texel[c]] : texel[c];
+						sum[c] += value * weight;
+					}
+				}
+			}
+			for (int c = 0; c < 4; ++c){
+				if (colorSpace == mipColorSRGB && c < 3)
+					out[x * 4 + c] = srgb.fromLinear[std::min(4095, (int)(sum[c] * 4095.0f + 0.5f))];
+				else
+					out[x * 4 + c] = (unsigned char)std::min(255.0f, sum[c] + 0.5f);
+			}
+		}
+	}
+}
+
+void mipDownsampleReference(
+	const unsigned char * source,
+	int sourceWidth,
+	int sourceHeight,
+	unsigned char * destination,
+	mipColorSpace colorSpace
+){
+	mipDownsampleRowsReference(source, sourceWidth, sourceHeight, destination, 0, std::max(1, sourceHeight / 2), colorSpace);
+}
+
+//
+// SIMD box filter for linear levels with even sizes
+//
+
+// Computes (a + b + c + d + 2) / 4 of 2x2 blocks, which matches the reference
+// exactly because the quarter of an integer sum is exact in float.
+static void mipDownsampleRowsEven(
+	const unsigned char * source, int sourceWidth,
+	unsigned char * destination, int firstRow, int lastRow
+){
+	const int width = sourceWidth / 2;
+	for (int y = firstRow; y < lastRow; ++y){
+		const unsigned char * row0 = source + (size_t)(2 * y) * sourceWidth * 4;
+		const unsigned char * row1 = row0 + (size_t)sourceWidth * 4;
+		unsigned char * out = destination + (size_t)y * width * 4;
+		int x = 0;
+#if defined(MIPMAP_AVX2)
+		const __m256i zero8 = _mm256_setzero_si256();
+		const __m256i two8 = _mm256_set1_epi16(2);
+		for (; x + 8 <= width; x += 8){
+			__m256i result[2];
+			for (int k = 0; k < 2; ++k){
+				// 8 source texels per row, 4 per 128 bit lane
+				__m256i a = _mm256_loadu_si256((const __m256i*)(row0 + (2 * x + 8 * k) * 4));
+				__m256i b = _mm256_loadu_si256((const __m256i*)(row1 + (2 * x + 8 * k) * 4));
+				__m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero8), _mm256_unpacklo_epi8(b, zero8));
+				__m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero8), _mm256_unpackhi_epi8(b, zero8));
+				lo = _mm256_add_epi16(lo, _mm256_srli_si256(lo, 8));
+				hi = _mm256_add_epi16(hi, _mm256_srli_si256(hi, 8));
+				result[k] = _mm256_srli_epi16(_mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), two8), 2);
+			}
+			// packing works per lane, restore the texel order afterwards
+			__m256i packed = _mm256_packus_epi16(result[0], result[1]);
+			_mm256_storeu_si256((__m256i*)(out + x * 4), _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+		}
+#endif
+#if defined(MIPMAP_SSE2)
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i two = _mm_set1_epi16(2);
+		for (; x + 4 <= width; x += 4){
+			__m128i result[2];
+			for (int k = 0; k < 2; ++k){
+				__m128i a = _mm_loadu_si128((const __m128i*)(row0 + (2 * x + 4 * k) * 4));
+				__m128i b = _mm_loadu_si128((const __m128i*)(row1 + (2 * x + 4 * k) * 4));
+				__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+				__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+				lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+				hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+				result[k] = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(lo, hi), two), 2);
+			}
+			_mm_storeu_si128((__m128i*)(out + x * 4), _mm_packus_epi16(result[0], result[1]));
+		}
+#endif
+		for (; x < width; ++x){
+			const unsigned char * a = row0 + x * 8;
+			const unsigned char * b = row1 + x * 8;
+			for (int c = 0; c < 4; ++c)
+				out[x * 4 + c] = (unsigned char)((a[c] + a[c + 4] + b[c] + b[c + 4] + 2) / 4);
+		}
+	}
+}
+
+//
+// SIMD filter for sRGB levels and odd sizes
+//
+
+#if defined(MIPMAP_SSE2)
+// Decodes a row of texels to floats, rgb through the sRGB table for sRGB levels.
+static void mipDecodeRow(const unsigned char * row, int width, mipColorSpace colorSpace, float * out)
+{
+	int x = 0;
+	if (colorSpace == mipColorSRGB){
+		const float * toLinear = mipGetSRGBTables().toLinear;
+		for (; x < width; ++x){
+			for (int c = 0; c < 3; ++c)
+				out[x * 4 + c] = toLinear[row[x * 4 + c]];
+			out[x * 4 + 3] = row[x * 4 + 3];
+		}
+		return;
+	}
+
+	const __m128i zero = _mm_setzero_si128();
+	for (; x + 4 <= width; x += 4){
+		__m128i bytes = _mm_loadu_si128((const __m128i*)(row + x * 4));
+		__m128i lo = _mm_unpacklo_epi8(bytes, zero);
+		__m128i hi = _mm_unpackhi_epi8(bytes, zero);
+		_mm_storeu_ps(out + x * 4, _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)));
+		_mm_storeu_ps(out + x * 4 + 4, _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)));
+		_mm_storeu_ps(out + x * 4 + 8, _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)));
+		_mm_storeu_ps(out + x * 4 + 12, _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)));
+	}
+	for (; x < width; ++x)
+		for (int c = 0; c < 4; ++c)
+			out[x * 4 + c] = row[x * 4 + c];
+}
+
+// Filters the decoded source rows into destination texels, one texel with its
+// four channels per register. Taps, weights and the order of the sums are
+// those of the reference, so the results are the same: odd sizes need no
+// scalar fallback because each column simply has three taps of its own weights.
+static void mipDownsampleRowsFloat(
+	const unsigned char * source, int sourceWidth, int sourceHeight,
+	unsigned char * destination, int firstRow, int lastRow, mipColorSpace colorSpace
+){
+	const mipSRGBTables & srgb = mipGetSRGBTables();
+	const int width = std::max(1, sourceWidth / 2);
+	std::vector<mipTaps> columns(width);
+	for (int x = 0; x < width; ++x)
+		columns[x] = mipComputeTaps(x, sourceWidth);
+
+	// odd heights share a source row between neighbouring destination rows, it is decoded once
+	std::vector<float> decoded[3];
+	int decodedRow[3] = { -1, -1, -1 };
+	for (int k = 0; k < 3; ++k)
+		decoded[k].resize((size_t)sourceWidth * 4);
+
+	// sRGB rgb is scaled to the index of the encoding table, everything else is rounded to bytes
+	const bool srgbColor = colorSpace == mipColorSRGB;
+	const __m128 scale = srgbColor ? _mm_setr_ps(4095.0f, 4095.0f, 4095.0f, 1.0f) : _mm_set1_ps(1.0f);
+	const __m128 limit = srgbColor ? _mm_setr_ps(4095.0f, 4095.0f, 4095.0f, 255.0f) : _mm_set1_ps(255.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+
+	for (int y = firstRow; y < lastRow; ++y){
+		mipTaps rows = mipComputeTaps(y, sourceHeight);
+		const float * rowTexels[3];
+		for (int j = 0; j < rows.count; ++j){
+			int row = rows.first + j;
+			int k = 0;
+			while (k < 3 && decodedRow[k] != row)
+				++k;
+			if (k == 3){
+				// take a buffer that holds none of the rows of this destination row
+				k = 0;
+				while (decodedRow[k] >= rows.first && decodedRow[k] < rows.first + rows.count)
+					++k;
+				mipDecodeRow(source + (size_t)row * sourceWidth * 4, sourceWidth, colorSpace, decoded[k].data());
+				decodedRow[k] = row;
+			}
+			rowTexels[j] = decoded[k].data();
+		}
+
+		unsigned char * out = destination + (size_t)y * width * 4;
+		for (int x = 0; x < width; ++x){
+			const mipTaps & taps = columns[x];
+			__m128 sum = _mm_setzero_ps();
+			for (int j = 0; j < rows.count; ++j){
+				const float * texels = rowTexels[j] + (size_t)taps.first * 4;
+				for (int i = 0; i < taps.count; ++i)
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(texels + i * 4), _mm_set1_ps(rows.weights[j] * taps.weights[i])));
+			}
+
+			int values[4];
+			_mm_storeu_si128((__m128i*)values, _mm_cvttps_epi32(_mm_min_ps(_mm_add_ps(_mm_mul_ps(sum, scale), half), limit)));
+			for (int c = 0; c < 3; ++c)
+				out[x * 4 + c] = srgbColor ? srgb.fromLinear[values[c]] : (unsigned char)values[c];
+			out[x * 4 + 3] = (unsigned char)values[3];
+		}
+	}
+}
+#endif
+
+//
+// Chain generation
+//
+
+static void mipDownsampleRows(
+	const unsigned char * source, int sourceWidth, int sourceHeight,
+	unsigned char * destination, int firstRow, int lastRow, mipColorSpace colorSpace
+){
+	if (colorSpace == mipColorLinear && sourceWidth % 2 == 0 && sourceHeight % 2 == 0)
+		mipDownsampleRowsEven(source, sourceWidth, destination, firstRow, lastRow);
+	else
+#if defined(MIPMAP_SSE2)
+		mipDownsampleRowsFloat(source, sourceWidth, sourceHeight, destination, firstRow, lastRow, colorSpace);
+#else
+		mipDownsampleRowsReference(source, sourceWidth, sourceHeight, destination, firstRow, lastRow, colorSpace);
+#endif
+}
+
+// one level split into bands of destination rows
+struct mipBands
+{
+	const unsigned char * source;
+	int sourceWidth;
+	int sourceHeight;
+	unsigned char * destination;
+	int rows;
+	unsigned int count;
+	mipColorSpace colorSpace;
+};
+
+static void mipDownsampleBand(size_t band, void * context)
+{
+	const mipBands & bands = *(const mipBands*)context;
+	mipDownsampleRows(bands.source, bands.sourceWidth, bands.sourceHeight, bands.destination,
+		(int)((size_t)bands.rows * band / bands.count), (int)((size_t)bands.rows * (band + 1) / bands.count), bands.colorSpace);
+}
+
+void buildMipChain(
+	unsigned char * chain,
+	int width,
+	int height,
+	mipColorSpace colorSpace,
+	unsigned int threadCount,
+	mipParallelFor parallelFor
+){
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	if (colorSpace == mipColorSRGB)
+		mipGetSRGBTables(); // build the tables before threads use them
+
+	unsigned char * level = chain;
+	for (int i = 1; i < mipLevelCount(width, height); ++i){
+		unsigned char * next = level + mipLevelSize(width, height, i - 1);
+		int sourceWidth = std::max(1, width >> (i - 1));
+		int sourceHeight = std::max(1, height >> (i - 1));
+		int rows = std::max(1, sourceHeight / 2);
+
+		// split the rows into bands, small levels aren't worth a thread
+		size_t texels = (size_t)rows * std::max(1, sourceWidth / 2);
+		mipBands bands = { level, sourceWidth, sourceHeight, next, rows, 0, colorSpace };
+		bands.count = (unsigned int)std::min<size_t>(std::min<size_t>(threadCount, rows), texels / 16384 + 1);
+		if (parallelFor && bands.count > 1)
+			parallelFor(bands.count, mipDownsampleBand, &bands);
+		else{
+			std::vector<std::thread> threads;
+			for (unsigned int band = 1; band < bands.count; ++band)
+				threads.push_back(std::thread(mipDownsampleBand, band, &bands));
+			mipDownsampleBand(0, &bands);
+			for (size_t t = 0; t < threads.size(); ++t)
+				threads[t].join();
+		}
+
+		level = next;
+	}
+}
+
+#endif
+
+#endif
@@ -1,25 +1,78 @@
 #ifndef OBJLOADER_H
 #define OBJLOADER_H
 
+#include <functional>
+#include <string>
+
+// Range of face corners that share the same object/group name and material.
+// A new range starts at every o, g and usemtl statement.
+struct objSubmesh
+{
+	std::string name;
+	std::string material;
+	unsigned int first;
+	unsigned int count;
+};
+
+// Faces may be triangles, quads or n-gons (triangulated as fans) with corners in
+// the forms v, v/t, v//n and v/t/n, including negative relative indices. Missing
+// uvs and normals are returned as zero.
 bool loadOBJ(
-	const char * path, 
-	std::vector<glm::vec3> & out_vertices, 
+	const char * path,
+	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
-	std::vector<glm::vec3> & out_normals
+	std::vector<glm::vec3> & out_normals,
+	unsigned int threadCount = 1, // 0 uses all hardware threads
+	std::vector<objSubmesh> * out_submeshes = NULL
+);
+
+// Same as loadOBJ, but every unique (position, uv, normal) combination is only
+// stored once and the triangles are returned as indices into the attributes.
+bool loadOBJIndexed(
+	const char * path,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<unsigned int> & out_indices,
+	unsigned int threadCount = 1,
+	std::vector<objSubmesh> * out_submeshes = NULL // ranges of out_indices
+);
+
+// Receives batchCorners triangle corners (three per triangle) of a streamed OBJ
+// file. The arrays are only valid during the call. Return false to stop loading.
+typedef std::function<bool(
+	const glm::vec3 * vertices,
+	const glm::vec2 * uvs,
+	const glm::vec3 * normals,
+	size_t batchCorners
+)> objTriangleSink;
+
+// Streams the triangles of an OBJ file to sink in batches of at most batchTriangles,
+// instead of collecting them. Only the v/vt/vn attribute pools and a single batch are
+// kept in memory, the mapped file is released behind the read position.
+bool loadOBJStream(
+	const char * path,
+	size_t batchTriangles,
+	const objTriangleSink & sink
 );
 
 #if defined(OBJLOADER_IMPLEMENTATION)
 
 #include <stdio.h>
+#include <stdint.h>
 #include <string>
 #include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <thread>
 
 #include <glm/glm.hpp>
 
+#include "fileio.h"
 #include "objloader.h"
 
 // Very, VERY simple OBJ loader.
-// Here is a short list of features a real function would provide : 
+// Here is a short list of features a real function would provide :
 // - Binary files. Reading a model should be just a few memcpy's away, not parsing a file at runtime. In short : OBJ is not very great.
 // - Animations & bones (includes bones weights)
 // - Multiple UVs
@@ -27,100 +80,608 @@ bool loadOBJ(
 // - More stable. Change a line in the OBJ file and it crashes.
 // - More secure. Change another line and you can inject code.
 // - Loading from memory, stream, etc
+//
+// The file is memory mapped through fileio.h and walked with a hand written
+// tokenizer, so no stdio and no locale dependent number parsing is involved
+// while reading.
+// Large files can be split at line boundaries and parsed on several threads.
+// The chunks are stitched together afterwards, so the result is identical to
+// parsing the file serially.
 
-bool loadOBJ(
-	const char * path, 
-	std::vector<glm::vec3> & out_vertices, 
-	std::vector<glm::vec2> & out_uvs,
-	std::vector<glm::vec3> & out_normals
-){
-	printf("Loading OBJ file %s...\n", path);
+//
+// Tokenizer
+//
 
-	std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
-	std::vector<glm::vec3> temp_vertices; 
-	std::vector<glm::vec2> temp_uvs;
-	std::vector<glm::vec3> temp_normals;
+static inline bool objIsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
 
+static inline bool objIsDigit(char c)
+{
+	return (unsigned char)(c - '0') < 10;
+}
 
-	FILE * file = fopen(path, "r");
-	if( file == NULL ){
-		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
-		getchar();
-		return false;
+static inline const char* objSkipSpaces(const char* p, const char* end)
+{
+	while (p < end && objIsSpace(*p)) ++p;
+	return p;
+}
+
+static inline const char* objSkipLine(const char* p, const char* end)
+{
+	const char* eol = (const char*)memchr(p, '\n', end - p);
+	return eol ? eol + 1 : end;
+}
+
+// Parses a decimal floating point number like strtof, but without locale
+// support, hex floats or inf/nan. Returns NULL if no number could be read.
+static const char* objParseFloat(const char* p, const char* end, float & out)
+{
+	static const double powersOf10[] = {
+		1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	p = objSkipSpaces(p, end);
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')){
+		negative = *p == '-';
+		++p;
+	}
+
+	uint64_t mantissa = 0;
+	int digits = 0;   // significant digits stored in the mantissa
+	int exponent = 0;
+	bool anyDigits = false;
+	for (; p < end && objIsDigit(*p); ++p){
+		anyDigits = true;
+		if (digits < 19){
+			mantissa = mantissa * 10 + (*p - '0');
+			if (mantissa) ++digits;
+		} else {
+			++exponent; // too many digits, drop them but keep the magnitude
+		}
+	}
+	if (p < end && *p == '.'){
+		++p;
+		for (; p < end && objIsDigit(*p); ++p){
+			anyDigits = true;
+			if (digits < 19){
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa) ++digits;
+				--exponent;
+			}
+		}
+	}
+	if (!anyDigits)
+		return NULL;
+
+	if (p < end && (*p == 'e' || *p == 'E')){
+		const char* q = p + 1;
+		bool negativeExponent = false;
+		if (q < end && (*q == '-' || *q == '+')){
+			negativeExponent = *q == '-';
+			++q;
+		}
+		if (q < end && objIsDigit(*q)){
+			int e = 0;
+			for (; q < end && objIsDigit(*q); ++q)
+				if (e < 10000) e = e * 10 + (*q - '0');
+			exponent += negativeExponent ? -e : e;
+			p = q;
+		}
+	}
+
+	double value = (double)mantissa;
+	if (exponent < 0)
+		value = exponent >= -22 ? value / powersOf10[-exponent] : value * std::pow(10.0, exponent);
+	else if (exponent > 0)
+		value = exponent <= 22 ? value * powersOf10[exponent] : value * std::pow(10.0, exponent);
+	out = (float)(negative ? -value : value);
+	return p;
+}
+
+// Largest index magnitude a face may use, see objEncodeIndex for the room above it.
+static const long long objMaxIndex = 0x3FFFFFFF;
+
+// Parses a signed decimal integer. Returns NULL if no digit could be read or
+// the magnitude is above objMaxIndex.
+static inline const char* objParseIndex(const char* p, const char* end, int & out)
+{
+	bool negative = p < end && *p == '-';
+	if (negative) ++p;
+	if (p >= end || !objIsDigit(*p))
+		return NULL;
+	long long value = 0;
+	for (; p < end && objIsDigit(*p); ++p){
+		value = value * 10 + (*p - '0');
+		if (value > objMaxIndex)
+			return NULL;
+	}
+	out = (int)(negative ? -value : value);
+	return p;
+}
+
+// Parses one face corner in the form v, v/t, v//n or v/t/n. Missing indices are 0.
+static inline const char* objParseCorner(const char* p, const char* end, int & v, int & t, int & n)
+{
+	t = n = 0;
+	if (!(p = objParseIndex(p, end, v))) return NULL;
+	if (p >= end || *p != '/') return p;
+	if (++p < end && *p != '/' && !(p = objParseIndex(p, end, t))) return NULL;
+	if (p >= end || *p != '/') return p;
+	return objParseIndex(p + 1, end, n);
+}
+
+// Negative indices count back from the attributes read so far. A chunk doesn't
+// know how many attributes the chunks before it hold, so these indices are
+// stored relative to the chunk start and tagged until the chunk offsets are known.
+// With magnitudes up to objMaxIndex, neither form reaches the tag.
+static const unsigned int objRelativeIndex = 0x80000000u;
+static const unsigned int objRelativeBias = 0x40000000u;
+
+// Relative indices that point before the first attribute decode to this one,
+// which no attribute pool reaches, so the lookup reports them as missing attributes.
+static const unsigned int objInvalidIndex = 0xFFFFFFFFu;
+
+static inline unsigned int objEncodeIndex(int index, size_t count)
+{
+	if (index >= 0)
+		return (unsigned int)index;
+	return objRelativeIndex | (unsigned int)std::max(0LL, (long long)count + index + 1 + objRelativeBias);
+}
+
+// Turns a tagged relative index into a 1-based absolute one, given the number of attributes before the chunk.
+static inline unsigned int objDecodeIndex(unsigned int index, size_t base)
+{
+	if (!(index & objRelativeIndex))
+		return index;
+	long long absolute = (long long)base + (long long)(index & ~objRelativeIndex) - objRelativeBias;
+	return absolute > 0 ? (unsigned int)absolute : objInvalidIndex;
+}
+
+// Looks up a 1-based attribute index, index 0 stands for a missing attribute.
+template <typename T>
+static inline bool objLookup(const std::vector<T> & pool, unsigned int index, T & out)
+{
+	if (index == 0){
+		out = T(0.0f);
+		return true;
 	}
+	if (index - 1 >= pool.size())
+		return false;
+	out = pool[index - 1];
+	return true;
+}
+
+// Returns the rest of the line without surrounding white space.
+static std::string objParseName(const char* p, const char* end)
+{
+	p = objSkipSpaces(p, end);
+	const char* last = p;
+	while (last < end && *last != '\n') ++last;
+	while (last > p && objIsSpace(last[-1])) --last;
+	return std::string(p, last);
+}
+
+//
+// Parser
+//
+
+// o, g or usemtl statement, first is the number of face corners read before it
+struct objSubmeshEvent
+{
+	size_t first;
+	bool material;
+	std::string name;
+};
+
+struct objParseState
+{
+	std::vector<glm::vec3> temp_vertices;
+	std::vector<glm::vec2> temp_uvs;
+	std::vector<glm::vec3> temp_normals;
+	std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
+	std::vector<objSubmeshEvent> submeshEvents;
+	std::vector<unsigned int> polygon; // (v, t, n) of the face being read
+	bool hasRelativeIndices;
 
-	while( 1 ){
+	objParseState() : hasRelativeIndices(false) {}
+};
 
-		char lineHeader[128];
-		// read the first word of the line
-		int res = fscanf(file, "%s", lineHeader);
-		if (res == EOF)
-			break; // EOF = End Of File. Quit the loop.
+// Parses all records in [p, end). Attributes are appended to the state, each
+// triangle is handed to onFace(vertexIndex, uvIndex, normalIndex) which returns
+// false to abort parsing. Polygons are split into a fan of triangles.
+template <typename FaceHandler>
+static bool objParseRecords(const char* p, const char* end, objParseState & state, FaceHandler onFace)
+{
+	while (p < end){
+		p = objSkipSpaces(p, end);
+		if (p >= end)
+			break;
 
-		// else : parse lineHeader
-		
-		if ( strcmp( lineHeader, "v" ) == 0 ){
+		const char* next = NULL;
+		if (p[0] == 'v' && p + 1 < end && objIsSpace(p[1])){
 			glm::vec3 vertex;
-			fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z );
-			temp_vertices.push_back(vertex);
-		} else if ( strcmp( lineHeader, "vt" ) == 0 ){
+			if ((next = objParseFloat(p + 1, end, vertex.x)) &&
+				(next = objParseFloat(next, end, vertex.y)) &&
+				(next = objParseFloat(next, end, vertex.z)))
+				state.temp_vertices.push_back(vertex);
+		} else if (p[0] == 'v' && p + 2 < end && p[1] == 't' && objIsSpace(p[2])){
 			glm::vec2 uv;
-			fscanf(file, "%f %f\n", &uv.x, &uv.y );
-			uv.y = -uv.y; // Invert V coordinate since we will only use DDS texture, which are inverted. Remove if you want to use TGA or BMP loaders.
-			temp_uvs.push_back(uv);
-		} else if ( strcmp( lineHeader, "vn" ) == 0 ){
+			if ((next = objParseFloat(p + 2, end, uv.x)) &&
+				(next = objParseFloat(next, end, uv.y))){
+				uv.y = -uv.y; // Invert V coordinate since we will only use DDS texture, which are inverted. Remove if you want to use TGA or BMP loaders.
+				state.temp_uvs.push_back(uv);
+			}
+		} else if (p[0] == 'v' && p + 2 < end && p[1] == 'n' && objIsSpace(p[2])){
 			glm::vec3 normal;
-			fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z );
-			temp_normals.push_back(normal);
-		} else if ( strcmp( lineHeader, "f" ) == 0 ){
-			std::string vertex1, vertex2, vertex3;
-			unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
-			int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &vertexIndex[0], &uvIndex[0], &normalIndex[0], &vertexIndex[1], &uvIndex[1], &normalIndex[1], &vertexIndex[2], &uvIndex[2], &normalIndex[2] );
-			if (matches != 9){
+			if ((next = objParseFloat(p + 2, end, normal.x)) &&
+				(next = objParseFloat(next, end, normal.y)) &&
+				(next = objParseFloat(next, end, normal.z)))
+				state.temp_normals.push_back(normal);
+		} else if (p[0] == 'f' && p + 1 < end && objIsSpace(p[1])){
+			std::vector<unsigned int> & polygon = state.polygon;
+			polygon.clear();
+			next = p + 1;
+			while (next){
+				next = objSkipSpaces(next, end);
+				if (next >= end || *next == '\n' || *next == '#')
+					break;
+				int v, t, n;
+				if (!(next = objParseCorner(next, end, v, t, n)) || v == 0){
+					next = NULL;
+					break;
+				}
+				state.hasRelativeIndices |= v < 0 || t < 0 || n < 0;
+				polygon.push_back(objEncodeIndex(v, state.temp_vertices.size()));
+				polygon.push_back(objEncodeIndex(t, state.temp_uvs.size()));
+				polygon.push_back(objEncodeIndex(n, state.temp_normals.size()));
+			}
+			if (!next || polygon.size() < 9){
 				printf("File can't be read by our simple parser :-( Try exporting with other options\n");
-				fclose(file);
 				return false;
 			}
-			vertexIndices.push_back(vertexIndex[0]);
-			vertexIndices.push_back(vertexIndex[1]);
-			vertexIndices.push_back(vertexIndex[2]);
-			uvIndices    .push_back(uvIndex[0]);
-			uvIndices    .push_back(uvIndex[1]);
-			uvIndices    .push_back(uvIndex[2]);
-			normalIndices.push_back(normalIndex[0]);
-			normalIndices.push_back(normalIndex[1]);
-			normalIndices.push_back(normalIndex[2]);
-		} else{
+			for (size_t i = 6; i < polygon.size(); i += 3){
+				unsigned int vertexIndex[3] = { polygon[0], polygon[i - 3], polygon[i] };
+				unsigned int uvIndex[3]     = { polygon[1], polygon[i - 2], polygon[i + 1] };
+				unsigned int normalIndex[3] = { polygon[2], polygon[i - 1], polygon[i + 2] };
+				if (!onFace(vertexIndex, uvIndex, normalIndex))
+					return false;
+			}
+		} else if ((p[0] == 'o' || p[0] == 'g') && p + 1 < end && objIsSpace(p[1])){
+			objSubmeshEvent event = { state.vertexIndices.size(), false, objParseName(p + 1, end) };
+			state.submeshEvents.push_back(event);
+			next = p;
+		} else if (end - p > 6 && memcmp(p, "usemtl", 6) == 0 && objIsSpace(p[6])){
+			objSubmeshEvent event = { state.vertexIndices.size(), true, objParseName(p + 6, end) };
+			state.submeshEvents.push_back(event);
+			next = p;
+		} else {
 			// Probably a comment, eat up the rest of the line
-			char stupidBuffer[1000];
-			fgets(stupidBuffer, 1000, file);
+			next = p;
 		}
 
+		if (!next){
+			printf("Malformed vertex attribute in OBJ file\n");
+			return false;
+		}
+		p = objSkipLine(next, end);
 	}
+	return true;
+}
+
+// Parses all records in [p, end) into the given state.
+static bool objParseRange(const char* p, const char* end, objParseState & state)
+{
+	return objParseRecords(p, end, state, [&](const unsigned int* vertexIndex, const unsigned int* uvIndex, const unsigned int* normalIndex){
+		state.vertexIndices.insert(state.vertexIndices.end(), vertexIndex, vertexIndex + 3);
+		state.uvIndices    .insert(state.uvIndices.end(), uvIndex, uvIndex + 3);
+		state.normalIndices.insert(state.normalIndices.end(), normalIndex, normalIndex + 3);
+		return true;
+	});
+}
 
+// Expands the face corners of a chunk into the preallocated output arrays,
+// starting at element first. Attributes are looked up in the merged pool.
+static bool objResolveFaces(
+	const objParseState & pool,
+	const objParseState & chunk,
+	size_t first,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+){
 	// For each vertex of each triangle
-	for( unsigned int i=0; i<vertexIndices.size(); i++ ){
-
-		// Get the indices of its attributes
-		unsigned int vertexIndex = vertexIndices[i];
-		unsigned int uvIndex = uvIndices[i];
-		unsigned int normalIndex = normalIndices[i];
-		
-		// Get the attributes thanks to the index
-		glm::vec3 vertex = temp_vertices[ vertexIndex-1 ];
-		glm::vec2 uv = temp_uvs[ uvIndex-1 ];
-		glm::vec3 normal = temp_normals[ normalIndex-1 ];
-		
-		// Put the attributes in buffers
-		out_vertices.push_back(vertex);
-		out_uvs     .push_back(uv);
-		out_normals .push_back(normal);
-	
+	for( size_t i=0; i<chunk.vertexIndices.size(); i++ ){
+
+		// Get the attributes thanks to the index and put them in buffers
+		if (!objLookup(pool.temp_vertices, chunk.vertexIndices[i], out_vertices[first + i]) ||
+			!objLookup(pool.temp_uvs,      chunk.uvIndices[i],     out_uvs     [first + i]) ||
+			!objLookup(pool.temp_normals,  chunk.normalIndices[i], out_normals [first + i])){
+			printf("OBJ face references a vertex attribute that does not exist\n");
+			return false;
+		}
+	}
+	return true;
+}
+
+// Runs function(threadIndex) on threadCount threads, using the calling thread as index 0.
+template <typename Function>
+static void objRunParallel(unsigned int threadCount, Function function)
+{
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < threadCount; ++i)
+		threads.push_back(std::thread(function, i));
+	function(0);
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+}
+
+template <typename T>
+static void objAppendAt(std::vector<T> & destination, size_t offset, const std::vector<T> & source)
+{
+	if (!source.empty())
+		memcpy(&destination[offset], source.data(), source.size() * sizeof(T));
+}
+
+// Maps the file, parses it on threadCount threads and merges the attribute pools.
+// The face indices stay in their chunks, faceOffsets holds the prefix sums of
+// the face corner counts.
+static bool objParseFile(
+	const char * path,
+	unsigned int threadCount,
+	objParseState & pool,
+	std::vector<objParseState> & chunks,
+	std::vector<size_t> & faceOffsets
+){
+	printf("Loading OBJ file %s...\n", path);
+
+	fileMapping file;
+	if( !fileMap(path, file) ){
+		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
+		return false;
+	}
+
+	// split the file into one chunk per thread, but don't bother for chunks below 1 MB
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	threadCount = (unsigned int)std::max<size_t>(1, std::min<size_t>(threadCount, file.size >> 20));
+
+	const char* end = file.data + file.size;
+	std::vector<const char*> boundaries(threadCount + 1, end);
+	boundaries[0] = file.data;
+	for (unsigned int i = 1; i < threadCount; ++i){
+		const char* split = std::max(boundaries[i - 1], file.data + file.size / threadCount * i);
+		boundaries[i] = split > file.data && split < end && split[-1] != '\n' ? objSkipLine(split, end) : split;
+	}
+
+	// parse every chunk into thread local attribute and index arrays
+	chunks.assign(threadCount, objParseState());
+	std::vector<char> chunkValid(threadCount, 0);
+	objRunParallel(threadCount, [&](unsigned int i){
+		chunkValid[i] = objParseRange(boundaries[i], boundaries[i + 1], chunks[i]);
+	});
+	fileUnmap(file);
+	if (std::find(chunkValid.begin(), chunkValid.end(), 0) != chunkValid.end())
+		return false;
+
+	// prefix sums over the chunk sizes give each chunk its place in the merged arrays
+	std::vector<size_t> vertexOffsets(threadCount + 1, 0), uvOffsets(threadCount + 1, 0), normalOffsets(threadCount + 1, 0);
+	faceOffsets.assign(threadCount + 1, 0);
+	for (unsigned int i = 0; i < threadCount; ++i){
+		vertexOffsets[i + 1] = vertexOffsets[i] + chunks[i].temp_vertices.size();
+		uvOffsets[i + 1]     = uvOffsets[i]     + chunks[i].temp_uvs.size();
+		normalOffsets[i + 1] = normalOffsets[i] + chunks[i].temp_normals.size();
+		faceOffsets[i + 1]   = faceOffsets[i]   + chunks[i].vertexIndices.size();
+	}
+
+	// OBJ indices are global, so the attribute pools are merged in file order
+	pool.temp_vertices.swap(chunks[0].temp_vertices);
+	pool.temp_uvs     .swap(chunks[0].temp_uvs);
+	pool.temp_normals .swap(chunks[0].temp_normals);
+	pool.temp_vertices.resize(vertexOffsets[threadCount]);
+	pool.temp_uvs     .resize(uvOffsets[threadCount]);
+	pool.temp_normals .resize(normalOffsets[threadCount]);
+	objRunParallel(threadCount, [&](unsigned int i){
+		objParseState & chunk = chunks[i];
+		if (chunk.hasRelativeIndices){
+			for (size_t j = 0; j < chunk.vertexIndices.size(); ++j){
+				chunk.vertexIndices[j] = objDecodeIndex(chunk.vertexIndices[j], vertexOffsets[i]);
+				chunk.uvIndices[j]     = objDecodeIndex(chunk.uvIndices[j],     uvOffsets[i]);
+				chunk.normalIndices[j] = objDecodeIndex(chunk.normalIndices[j], normalOffsets[i]);
+			}
+		}
+		if (i == 0) return;
+		objAppendAt(pool.temp_vertices, vertexOffsets[i], chunks[i].temp_vertices);
+		objAppendAt(pool.temp_uvs,      uvOffsets[i],     chunks[i].temp_uvs);
+		objAppendAt(pool.temp_normals,  normalOffsets[i], chunks[i].temp_normals);
+		std::vector<glm::vec3>().swap(chunks[i].temp_vertices);
+		std::vector<glm::vec2>().swap(chunks[i].temp_uvs);
+		std::vector<glm::vec3>().swap(chunks[i].temp_normals);
+	});
+	return true;
+}
+
+// Turns the o/g/usemtl statements of all chunks into ranges of the face corners,
+// which start at first in the output.
+static void objBuildSubmeshes(
+	const std::vector<objParseState> & chunks,
+	const std::vector<size_t> & faceOffsets,
+	size_t first,
+	std::vector<objSubmesh> & out_submeshes
+){
+	objSubmesh current;
+	current.first = (unsigned int)first;
+	for (size_t c = 0; c < chunks.size(); ++c){
+		for (size_t i = 0; i < chunks[c].submeshEvents.size(); ++i){
+			const objSubmeshEvent & event = chunks[c].submeshEvents[i];
+			unsigned int position = (unsigned int)(first + faceOffsets[c] + event.first);
+			current.count = position - current.first;
+			if (current.count > 0)
+				out_submeshes.push_back(current);
+			current.first = position;
+			(event.material ? current.material : current.name) = event.name;
+		}
+	}
+	current.count = (unsigned int)(first + faceOffsets.back()) - current.first;
+	if (current.count > 0)
+		out_submeshes.push_back(current);
+}
+
+bool loadOBJ(
+	const char * path,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	unsigned int threadCount,
+	std::vector<objSubmesh> * out_submeshes
+){
+	objParseState pool;
+	std::vector<objParseState> chunks;
+	std::vector<size_t> faceOffsets;
+	if (!objParseFile(path, threadCount, pool, chunks, faceOffsets))
+		return false;
+
+	size_t first = out_vertices.size();
+	out_vertices.resize(first + faceOffsets.back());
+	out_uvs     .resize(first + faceOffsets.back());
+	out_normals .resize(first + faceOffsets.back());
+
+	std::vector<char> chunkValid(chunks.size(), 0);
+	objRunParallel((unsigned int)chunks.size(), [&](unsigned int i){
+		chunkValid[i] = objResolveFaces(pool, chunks[i], first + faceOffsets[i], out_vertices, out_uvs, out_normals);
+	});
+	if (out_submeshes)
+		objBuildSubmeshes(chunks, faceOffsets, first, *out_submeshes);
+	return std::find(chunkValid.begin(), chunkValid.end(), 0) == chunkValid.end();
+}
+
+static inline size_t objHashCorner(unsigned int v, unsigned int t, unsigned int n)
+{
+	return (v * 73856093u) ^ (t * 19349663u) ^ (n * 83492791u);
+}
+
+bool loadOBJIndexed(
+	const char * path,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<unsigned int> & out_indices,
+	unsigned int threadCount,
+	std::vector<objSubmesh> * out_submeshes
+){
+	objParseState pool;
+	std::vector<objParseState> chunks;
+	std::vector<size_t> faceOffsets;
+	if (!objParseFile(path, threadCount, pool, chunks, faceOffsets))
+		return false;
+
+	// open addressing table from (v, t, n) to the output vertex, sized for at most 50% load
+	size_t slotCount = 16;
+	while (slotCount < faceOffsets.back() * 2) slotCount *= 2;
+	std::vector<unsigned int> slots(slotCount, 0); // output vertex + 1, 0 is empty
+	std::vector<unsigned int> keys;                // (v, t, n) of every unique vertex
+	keys.reserve(faceOffsets.back());
+
+	size_t first = out_vertices.size();
+	if (out_submeshes)
+		objBuildSubmeshes(chunks, faceOffsets, out_indices.size(), *out_submeshes);
+	out_indices.reserve(out_indices.size() + faceOffsets.back());
+	for (size_t c = 0; c < chunks.size(); ++c){
+		const objParseState & chunk = chunks[c];
+		for (size_t i = 0; i < chunk.vertexIndices.size(); ++i){
+			unsigned int vertexIndex = chunk.vertexIndices[i];
+			unsigned int uvIndex = chunk.uvIndices[i];
+			unsigned int normalIndex = chunk.normalIndices[i];
+
+			size_t slot = objHashCorner(vertexIndex, uvIndex, normalIndex) & (slotCount - 1);
+			while (slots[slot]){
+				const unsigned int* key = &keys[(slots[slot] - 1) * 3];
+				if (key[0] == vertexIndex && key[1] == uvIndex && key[2] == normalIndex)
+					break;
+				slot = (slot + 1) & (slotCount - 1);
+			}
+
+			if (!slots[slot]){
+				glm::vec3 vertex, normal;
+				glm::vec2 uv;
+				if (!objLookup(pool.temp_vertices, vertexIndex, vertex) ||
+					!objLookup(pool.temp_uvs, uvIndex, uv) ||
+					!objLookup(pool.temp_normals, normalIndex, normal)){
+					printf("OBJ face references a vertex attribute that does not exist\n");
+					return false;
+				}
+				keys.push_back(vertexIndex);
+				keys.push_back(uvIndex);
+				keys.push_back(normalIndex);
+				slots[slot] = (unsigned int)(keys.size() / 3);
+				out_vertices.push_back(vertex);
+				out_uvs     .push_back(uv);
+				out_normals .push_back(normal);
+			}
+			out_indices.push_back((unsigned int)first + slots[slot] - 1);
+		}
 	}
-	fclose(file);
 	return true;
 }
 
+bool loadOBJStream(
+	const char * path,
+	size_t batchTriangles,
+	const objTriangleSink & sink
+){
+	printf("Streaming OBJ file %s...\n", path);
+
+	fileMapping file;
+	if( !fileMap(path, file) ){
+		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
+		return false;
+	}
+
+	const size_t batchCorners = std::max<size_t>(1, batchTriangles) * 3;
+	std::vector<glm::vec3> batch_vertices(batchCorners);
+	std::vector<glm::vec2> batch_uvs(batchCorners);
+	std::vector<glm::vec3> batch_normals(batchCorners);
+	size_t corners = 0;
+
+	// faces are resolved right away, so they may only reference attributes defined before them.
+	// There is a single chunk starting at the file begin, so relative indices have base 0.
+	objParseState pool;
+	auto onFace = [&](const unsigned int* vertexIndex, const unsigned int* uvIndex, const unsigned int* normalIndex){
+		for (int i = 0; i < 3; ++i){
+			if (!objLookup(pool.temp_vertices, objDecodeIndex(vertexIndex[i], 0), batch_vertices[corners]) ||
+				!objLookup(pool.temp_uvs,      objDecodeIndex(uvIndex[i], 0),     batch_uvs     [corners]) ||
+				!objLookup(pool.temp_normals,  objDecodeIndex(normalIndex[i], 0), batch_normals [corners])){
+				printf("OBJ face references a vertex attribute that does not exist\n");
+				return false;
+			}
+			++corners;
+		}
+		if (corners < batchCorners)
+			return true;
+		corners = 0;
+		return sink(batch_vertices.data(), batch_uvs.data(), batch_normals.data(), batchCorners);
+	};
+
+	// walk the file in windows of 64 MB and unmap everything behind the current window
+	const size_t windowSize = 64u << 20;
+	const char* end = file.data + file.size;
+	bool res = true;
+	for (const char* window = file.data; res && window < end; ){
+		const char* windowEnd = (size_t)(end - window) > windowSize ? objSkipLine(window + windowSize, end) : end;
+		res = objParseRecords(window, windowEnd, pool, onFace);
+		fileReleasePages(file, file.data, windowEnd);
+		window = windowEnd;
+	}
+	if (res && corners > 0)
+		res = sink(batch_vertices.data(), batch_uvs.data(), batch_normals.data(), corners);
+
+	fileUnmap(file);
+	return res;
+}
+
 #endif
 
 #endif
@@ -0,0 +1,734 @@
+#ifndef VERTEXSTREAMS_H
+#define VERTEXSTREAMS_H
+
+#include <stddef.h>
+
+// Vertex attributes stored as one array per component (struct of arrays), so
+// loops over many vertices work on whole SIMD registers instead of single
+// vertices. All component arrays live in one 32 byte aligned block and are
+// padded to a multiple of 8 vertices. Kernels may read and write the padding,
+// which is zero after allocation.
+//
+// The interleaved form has 11 floats per vertex in component order: position,
+// texcoord, normal and color.
+
+enum vertexComponent
+{
+	vertexPositionX, vertexPositionY, vertexPositionZ,
+	vertexTexcoordU, vertexTexcoordV,
+	vertexNormalX, vertexNormalY, vertexNormalZ,
+	vertexColorR, vertexColorG, vertexColorB,
+	vertexComponentCount
+};
+
+// Attributes made of consecutive components.
+enum vertexStream
+{
+	vertexStreamPosition,
+	vertexStreamTexcoord,
+	vertexStreamNormal,
+	vertexStreamColor,
+	vertexStreamCount
+};
+
+// Zero initialize before the first use.
+struct vertexStreams
+{
+	float * data;      // component c of vertex i is data[c * capacity + i]
+	size_t count;
+	size_t capacity;   // vertices per component array, a multiple of 8
+};
+
+// Makes room for count vertices and sets the count, the previous content is lost.
+bool vertexStreamsAllocate(vertexStreams & streams, size_t count);
+void vertexStreamsRelease(vertexStreams & streams);
+
+inline float * vertexStreamsComponent(const vertexStreams & streams, int component)
+{
+	return streams.data + (size_t)component * streams.capacity;
+}
+
+int vertexStreamFirstComponent(vertexStream stream);
+int vertexStreamComponentCount(vertexStream stream);
+
+// Conversion from and to the interleaved form, streams must be allocated for count vertices.
+void vertexStreamsFromInterleaved(const float * vertices, size_t count, vertexStreams & streams);
+void vertexStreamsToInterleaved(const vertexStreams & streams, float * vertices);
+
+// Writes the components of one attribute interleaved, e.g. xyz xyz for positions,
+// as stored in a vertex buffer that holds each attribute on its own.
+void vertexStreamsToStream(const vertexStreams & streams, vertexStream stream, float * values);
+
+// Transforms the positions by the column major 4x4 matrix, ignoring its
+// projective row, and the normals by the inverse transpose of its upper 3x3.
+// Normals keep their length changes, see vertexStreamsNormalize.
+void vertexStreamsTransform(vertexStreams & streams, const float * matrix);
+
+// out = a + (b - a) * t for every component, out may be a or b. All three
+// must be allocated for the same count.
+void vertexStreamsLerp(const vertexStreams & a, const vertexStreams & b, float t, vertexStreams & out);
+
+// Scales the normals to unit length, zero normals stay zero.
+void vertexStreamsNormalize(vertexStreams & streams);
+
+// Smallest box around the positions, an empty box has lower > upper.
+void vertexStreamsBounds(const vertexStreams & streams, float * lower, float * upper);
+
+enum vertexNormalWeighting
+{
+	vertexNormalsArea,  // faces contribute in proportion to their area
+	vertexNormalsAngle  // faces contribute in proportion to their corner angle at the vertex
+};
+
+// Runs work(item, context) for the items 0 to count - 1 on any threads and
+// returns once all of them are done, e.g. on the worker threads of the caller.
+typedef void (*vertexStreamsParallelFor)(size_t count, void (*work)(size_t item, void * context), void * context);
+
+// Unit face normals of a triangle soup, every three consecutive vertices are a
+// counter clockwise triangle whose normal is written to all three corners.
+// Triangles are split into threadCount bands, 0 uses all hardware threads,
+// which run through parallelFor if given, otherwise on threads of their own.
+// Degenerate triangles get zero normals.
+void vertexStreamsFlatNormals(vertexStreams & streams, unsigned int threadCount = 1, vertexStreamsParallelFor parallelFor = NULL);
+
+// Unit smooth normals of an indexed triangle mesh, the sum of the normals of
+// the faces around each vertex. Faces are computed in threadCount bands like
+// the flat normals, vertices that belong to no face get zero normals.
+void vertexStreamsSmoothNormals(
+	vertexStreams & streams,
+	const unsigned int * indices,
+	size_t indexCount,
+	vertexNormalWeighting weighting,
+	unsigned int threadCount = 1,
+	vertexStreamsParallelFor parallelFor = NULL
+);
+
+#if defined(VERTEXSTREAMS_IMPLEMENTATION)
+
+#include <stdlib.h>
+#include <string.h>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VERTEXSTREAMS_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VERTEXSTREAMS_SSE2
+#endif
+
+//
+// Lanes
+//
+
+// The kernels are written once against these wrappers and process vsWidth
+// vertices per step: 8 with AVX2, 4 with SSE2 and 1 without SIMD.
+#if defined(VERTEXSTREAMS_AVX2)
+typedef __m256 vsFloat;
+static const size_t vsWidth = 8;
+static inline vsFloat vsLoad(const float * p) { return _mm256_load_ps(p); }
+static inline void vsStore(float * p, vsFloat a) { _mm256_store_ps(p, a); }
+static inline vsFloat vsSet(float a) { return _mm256_set1_ps(a); }
+static inline vsFloat vsAdd(vsFloat a, vsFloat b) { return _mm256_add_ps(a, b); }
+static inline vsFloat vsSub(vsFloat a, vsFloat b) { return _mm256_sub_ps(a, b); }
+static inline vsFloat vsMul(vsFloat a, vsFloat b) { return _mm256_mul_ps(a, b); }
+static inline vsFloat vsDiv(vsFloat a, vsFloat b) { return _mm256_div_ps(a, b); }
+static inline vsFloat vsSqrt(vsFloat a) { return _mm256_sqrt_ps(a); }
+static inline vsFloat vsMin(vsFloat a, vsFloat b) { return _mm256_min_ps(a, b); }
+static inline vsFloat vsMax(vsFloat a, vsFloat b) { return _mm256_max_ps(a, b); }
+static inline vsFloat vsSelectPositive(vsFloat test, vsFloat a) { return _mm256_and_ps(_mm256_cmp_ps(test, _mm256_setzero_ps(), _CMP_GT_OQ), a); }
+static inline vsFloat vsSelectNegative(vsFloat test, vsFloat a, vsFloat b) { return _mm256_blendv_ps(b, a, _mm256_cmp_ps(test, _mm256_setzero_ps(), _CMP_LT_OQ)); }
+static inline vsFloat vsAbs(vsFloat a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+static inline void vsLanes(vsFloat a, float * lanes) { _mm256_storeu_ps(lanes, a); }
+
+// values at indices[0], indices[3], ... indices[21]
+static inline vsFloat vsGather(const float * values, const unsigned int * indices)
+{
+	__m256i offsets = _mm256_setr_epi32(indices[0], indices[3], indices[6], indices[9], indices[12], indices[15], indices[18], indices[21]);
+	return _mm256_i32gather_ps(values, offsets, 4);
+}
+
+// Splits 8 triangles of consecutive corners into the first, second and third corners.
+static inline void vsLoadCorners(const float * values, vsFloat * corners)
+{
+	__m256 r0 = _mm256_load_ps(values), r1 = _mm256_load_ps(values + 8), r2 = _mm256_load_ps(values + 16);
+	corners[0] = _mm256_permutevar8x32_ps(_mm256_blend_ps(_mm256_blend_ps(r0, r1, 0x92), r2, 0x24), _mm256_setr_epi32(0, 3, 6, 1, 4, 7, 2, 5));
+	corners[1] = _mm256_permutevar8x32_ps(_mm256_blend_ps(_mm256_blend_ps(r0, r1, 0x24), r2, 0x49), _mm256_setr_epi32(1, 4, 7, 2, 5, 0, 3, 6));
+	corners[2] = _mm256_permutevar8x32_ps(_mm256_blend_ps(_mm256_blend_ps(r0, r1, 0x49), r2, 0x92), _mm256_setr_epi32(2, 5, 0, 3, 6, 1, 4, 7));
+}
+
+// Writes the value of each of 8 triangles to its three corners.
+static inline void vsStoreCorners(float * values, vsFloat a)
+{
+	_mm256_store_ps(values, _mm256_permutevar8x32_ps(a, _mm256_setr_epi32(0, 0, 0, 1, 1, 1, 2, 2)));
+	_mm256_store_ps(values + 8, _mm256_permutevar8x32_ps(a, _mm256_setr_epi32(2, 3, 3, 3, 4, 4, 4, 5)));
+	_mm256_store_ps(values + 16, _mm256_permutevar8x32_ps(a, _mm256_setr_epi32(5, 5, 6, 6, 6, 7, 7, 7)));
+}
+#elif defined(VERTEXSTREAMS_SSE2)
+typedef __m128 vsFloat;
+static const size_t vsWidth = 4;
+static inline vsFloat vsLoad(const float * p) { return _mm_load_ps(p); }
+static inline void vsStore(float * p, vsFloat a) { _mm_store_ps(p, a); }
+static inline vsFloat vsSet(float a) { return _mm_set1_ps(a); }
+static inline vsFloat vsAdd(vsFloat a, vsFloat b) { return _mm_add_ps(a, b); }
+static inline vsFloat vsSub(vsFloat a, vsFloat b) { return _mm_sub_ps(a, b); }
+static inline vsFloat vsMul(vsFloat a, vsFloat b) { return _mm_mul_ps(a, b); }
+static inline vsFloat vsDiv(vsFloat a, vsFloat b) { return _mm_div_ps(a, b); }
+static inline vsFloat vsSqrt(vsFloat a) { return _mm_sqrt_ps(a); }
+static inline vsFloat vsMin(vsFloat a, vsFloat b) { return _mm_min_ps(a, b); }
+static inline vsFloat vsMax(vsFloat a, vsFloat b) { return _mm_max_ps(a, b); }
+static inline vsFloat vsSelectPositive(vsFloat test, vsFloat a) { return _mm_and_ps(_mm_cmpgt_ps(test, _mm_setzero_ps()), a); }
+static inline vsFloat vsSelectNegative(vsFloat test, vsFloat a, vsFloat b)
+{
+	__m128 mask = _mm_cmplt_ps(test, _mm_setzero_ps());
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+static inline vsFloat vsAbs(vsFloat a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+static inline void vsLanes(vsFloat a, float * lanes) { _mm_storeu_ps(lanes, a); }
+
+static inline vsFloat vsGather(const float * values, const unsigned int * indices)
+{
+	return _mm_setr_ps(values[indices[0]], values[indices[3]], values[indices[6]], values[indices[9]]);
+}
+
+static inline void vsLoadCorners(const float * values, vsFloat * corners)
+{
+	__m128 r0 = _mm_load_ps(values), r1 = _mm_load_ps(values + 4), r2 = _mm_load_ps(values + 8);
+	corners[0] = _mm_shuffle_ps(r0, _mm_shuffle_ps(r1, r2, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+	corners[1] = _mm_shuffle_ps(_mm_shuffle_ps(r0, r1, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(r1, r2, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+	corners[2] = _mm_shuffle_ps(_mm_shuffle_ps(r0, r1, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(r2, r2, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+static inline void vsStoreCorners(float * values, vsFloat a)
+{
+	_mm_store_ps(values, _mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 0, 0, 0)));
+	_mm_store_ps(values + 4, _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 1, 1)));
+	_mm_store_ps(values + 8, _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 3, 2)));
+}
+#else
+typedef float vsFloat;
+static const size_t vsWidth = 1;
+static inline vsFloat vsLoad(const float * p) { return *p; }
+static inline void vsStore(float * p, vsFloat a) { *p = a; }
+static inline vsFloat vsSet(float a) { return a; }
+static inline vsFloat vsAdd(vsFloat a, vsFloat b) { return a + b; }
+static inline vsFloat vsSub(vsFloat a, vsFloat b) { return a - b; }
+static inline vsFloat vsMul(vsFloat a, vsFloat b) { return a * b; }
+static inline vsFloat vsDiv(vsFloat a, vsFloat b) { return a / b; }
+static inline vsFloat vsSqrt(vsFloat a) { return std::sqrt(a); }
+static inline vsFloat vsMin(vsFloat a, vsFloat b) { return std::min(a, b); }
+static inline vsFloat vsMax(vsFloat a, vsFloat b) { return std::max(a, b); }
+static inline vsFloat vsSelectPositive(vsFloat test, vsFloat a) { return test > 0.0f ? a : 0.0f; }
+static inline vsFloat vsSelectNegative(vsFloat test, vsFloat a, vsFloat b) { return test < 0.0f ? a : b; }
+static inline vsFloat vsAbs(vsFloat a) { return std::abs(a); }
+static inline void vsLanes(vsFloat a, float * lanes) { *lanes = a; }
+static inline vsFloat vsGather(const float * values, const unsigned int * indices) { return values[indices[0]]; }
+
+static inline void vsLoadCorners(const float * values, vsFloat * corners)
+{
+	corners[0] = values[0];
+	corners[1] = values[1];
+	corners[2] = values[2];
+}
+
+static inline void vsStoreCorners(float * values, vsFloat a)
+{
+	values[0] = values[1] = values[2] = a;
+}
+#endif
+
+//
+// Storage
+//
+
+static const int vsStreamFirst[vertexStreamCount + 1] = { vertexPositionX, vertexTexcoordU, vertexNormalX, vertexColorR, vertexComponentCount };
+
+int vertexStreamFirstComponent(vertexStream stream)
+{
+	return vsStreamFirst[stream];
+}
+
+int vertexStreamComponentCount(vertexStream stream)
+{
+	return vsStreamFirst[stream + 1] - vsStreamFirst[stream];
+}
+
+static float * vsAllocate(size_t count)
+{
+#if defined(_WIN32)
+	return (float*)_aligned_malloc(count * sizeof(float), 32);
+#else
+	void * data = NULL;
+	return posix_memalign(&data, 32, count * sizeof(float)) == 0 ? (float*)data : NULL;
+#endif
+}
+
+static void vsFree(float * data)
+{
+#if defined(_WIN32)
+	_aligned_free(data);
+#else
+	free(data);
+#endif
+}
+
+bool vertexStreamsAllocate(vertexStreams & streams, size_t count)
+{
+	size_t capacity = (count + 7) & ~(size_t)7;
+	if (!streams.data || capacity > streams.capacity){
+		vertexStreamsRelease(streams);
+		streams.data = vsAllocate(std::max<size_t>(capacity, 8) * vertexComponentCount);
+		if (!streams.data)
+			return false;
+		streams.capacity = std::max<size_t>(capacity, 8);
+	}
+	memset(streams.data, 0, streams.capacity * vertexComponentCount * sizeof(float));
+	streams.count = count;
+	return true;
+}
+
+void vertexStreamsRelease(vertexStreams & streams)
+{
+	vsFree(streams.data);
+	streams.data = NULL;
+	streams.count = 0;
+	streams.capacity = 0;
+}
+
+//
+// Conversion
+//
+
+#if defined(VERTEXSTREAMS_AVX2)
+// Transposes 8 rows of 8 floats in place.
+static inline void vsTranspose8(__m256 * rows)
+{
+	__m256 t[8], s[8];
+	for (int i = 0; i < 8; i += 2){
+		t[i] = _mm256_unpacklo_ps(rows[i], rows[i + 1]);
+		t[i + 1] = _mm256_unpackhi_ps(rows[i], rows[i + 1]);
+	}
+	for (int i = 0; i < 8; i += 4){
+		s[i] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+		s[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+		s[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+		s[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+	}
+	for (int i = 0; i < 4; ++i){
+		rows[i] = _mm256_permute2f128_ps(s[i], s[i + 4], 0x20);
+		rows[i + 4] = _mm256_permute2f128_ps(s[i], s[i + 4], 0x31);
+	}
+}
+#endif
+
+void vertexStreamsFromInterleaved(const float * vertices, size_t count, vertexStreams & streams)
+{
+	float * components[vertexComponentCount];
+	for (int c = 0; c < vertexComponentCount; ++c)
+		components[c] = vertexStreamsComponent(streams, c);
+	size_t i = 0;
+#if defined(VERTEXSTREAMS_AVX2)
+	// the first 8 components of 8 vertices are one 8x8 transpose, the last 3 two 4x4 transposes
+	for (; i + 8 <= count; i += 8){
+		const float * block = vertices + i * vertexComponentCount;
+		__m256 rows[8];
+		for (int v = 0; v < 8; ++v)
+			rows[v] = _mm256_loadu_ps(block + v * vertexComponentCount);
+		vsTranspose8(rows);
+		for (int c = 0; c < 8; ++c)
+			_mm256_store_ps(components[c] + i, rows[c]);
+
+		__m128 tail[8];
+		for (int v = 0; v < 8; ++v){
+			const float * last = block + v * vertexComponentCount + 8;
+			tail[v] = _mm_movelh_ps(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)last), _mm_load_ss(last + 2));
+		}
+		_MM_TRANSPOSE4_PS(tail[0], tail[1], tail[2], tail[3]);
+		_MM_TRANSPOSE4_PS(tail[4], tail[5], tail[6], tail[7]);
+		for (int c = 0; c < 3; ++c)
+			_mm256_store_ps(components[8 + c] + i, _mm256_insertf128_ps(_mm256_castps128_ps256(tail[c]), tail[4 + c], 1));
+	}
+#endif
+	for (; i < count; ++i)
+		for (int c = 0; c < vertexComponentCount; ++c)
+			components[c][i] = vertices[i * vertexComponentCount + c];
+}
+
+void vertexStreamsToInterleaved(const vertexStreams & streams, float * vertices)
+{
+	const float * components[vertexComponentCount];
+	for (int c = 0; c < vertexComponentCount; ++c)
+		components[c] = vertexStreamsComponent(streams, c);
+	size_t i = 0;
+#if defined(VERTEXSTREAMS_AVX2)
+	for (; i + 8 <= streams.count; i += 8){
+		float * block = vertices + i * vertexComponentCount;
+		__m256 rows[8];
+		for (int c = 0; c < 8; ++c)
+			rows[c] = _mm256_load_ps(components[c] + i);
+		vsTranspose8(rows);
+
+		__m128 tail[8];
+		for (int c = 0; c < 3; ++c){
+			__m256 column = _mm256_load_ps(components[8 + c] + i);
+			tail[c] = _mm256_castps256_ps128(column);
+			tail[4 + c] = _mm256_extractf128_ps(column, 1);
+		}
+		tail[3] = tail[7] = _mm_setzero_ps();
+		_MM_TRANSPOSE4_PS(tail[0], tail[1], tail[2], tail[3]);
+		_MM_TRANSPOSE4_PS(tail[4], tail[5], tail[6], tail[7]);
+
+		// vertices are 11 floats, so the last 3 are stored as 2 + 1 to stay inside the vertex
+		for (int v = 0; v < 8; ++v){
+			float * out = block + v * vertexComponentCount;
+			_mm256_storeu_ps(out, rows[v]);
+			_mm_storel_pi((__m64*)(out + 8), tail[v]);
+			_mm_store_ss(out + 10, _mm_movehl_ps(tail[v], tail[v]));
+		}
+	}
+#endif
+	for (; i < streams.count; ++i)
+		for (int c = 0; c < vertexComponentCount; ++c)
+			vertices[i * vertexComponentCount + c] = components[c][i];
+}
+
+void vertexStreamsToStream(const vertexStreams & streams, vertexStream stream, float * values)
+{
+	const int first = vertexStreamFirstComponent(stream);
+	const int width = vertexStreamComponentCount(stream);
+	const float * components[3];
+	for (int c = 0; c < width; ++c)
+		components[c] = vertexStreamsComponent(streams, first + c);
+	for (size_t i = 0; i < streams.count; ++i)
+		for (int c = 0; c < width; ++c)
+			values[i * width + c] = components[c][i];
+}
+
+//
+// Kernels
+//
+
+void vertexStreamsTransform(vertexStreams & streams, const float * m)
+{
+	// inverse transpose of the upper 3x3 from its cofactors, both column major
+	float cofactors[9] = {
+		m[5] * m[10] - m[6] * m[9], m[6] * m[8] - m[4] * m[10], m[4] * m[9] - m[5] * m[8],
+		m[2] * m[9] - m[1] * m[10], m[0] * m[10] - m[2] * m[8], m[1] * m[8] - m[0] * m[9],
+		m[1] * m[6] - m[2] * m[5], m[2] * m[4] - m[0] * m[6], m[0] * m[5] - m[1] * m[4]
+	};
+	float determinant = m[0] * cofactors[0] + m[1] * cofactors[1] + m[2] * cofactors[2];
+	float inverse = determinant != 0.0f ? 1.0f / determinant : 0.0f;
+	vsFloat n[9], p[12];
+	for (int k = 0; k < 9; ++k)
+		n[k] = vsSet(cofactors[k] * inverse);
+	for (int k = 0; k < 12; ++k)
+		p[k] = vsSet(m[k < 9 ? k + k / 3 : k + 3]); // columns 0 to 2 without w, then the translation
+
+	float * px = vertexStreamsComponent(streams, vertexPositionX);
+	float * py = vertexStreamsComponent(streams, vertexPositionY);
+	float * pz = vertexStreamsComponent(streams, vertexPositionZ);
+	float * nx = vertexStreamsComponent(streams, vertexNormalX);
+	float * ny = vertexStreamsComponent(streams, vertexNormalY);
+	float * nz = vertexStreamsComponent(streams, vertexNormalZ);
+	for (size_t i = 0; i < streams.count; i += vsWidth){
+		vsFloat x = vsLoad(px + i), y = vsLoad(py + i), z = vsLoad(pz + i);
+		vsStore(px + i, vsAdd(vsAdd(vsMul(p[0], x), vsMul(p[3], y)), vsAdd(vsMul(p[6], z), p[9])));
+		vsStore(py + i, vsAdd(vsAdd(vsMul(p[1], x), vsMul(p[4], y)), vsAdd(vsMul(p[7], z), p[10])));
+		vsStore(pz + i, vsAdd(vsAdd(vsMul(p[2], x), vsMul(p[5], y)), vsAdd(vsMul(p[8], z), p[11])));
+
+		x = vsLoad(nx + i); y = vsLoad(ny + i); z = vsLoad(nz + i);
+		vsStore(nx + i, vsAdd(vsAdd(vsMul(n[0], x), vsMul(n[3], y)), vsMul(n[6], z)));
+		vsStore(ny + i, vsAdd(vsAdd(vsMul(n[1], x), vsMul(n[4], y)), vsMul(n[7], z)));
+		vsStore(nz + i, vsAdd(vsAdd(vsMul(n[2], x), vsMul(n[5], y)), vsMul(n[8], z)));
+	}
+}
+
+void vertexStreamsLerp(const vertexStreams & a, const vertexStreams & b, float t, vertexStreams & out)
+{
+	const vsFloat weight = vsSet(t);
+	for (int c = 0; c < vertexComponentCount; ++c){
+		const float * from = vertexStreamsComponent(a, c);
+		const float * to = vertexStreamsComponent(b, c);
+		float * result = vertexStreamsComponent(out, c);
+		for (size_t i = 0; i < out.count; i += vsWidth){
+			vsFloat x = vsLoad(from + i);
+			vsStore(result + i, vsAdd(x, vsMul(vsSub(vsLoad(to + i), x), weight)));
+		}
+	}
+}
+
+void vertexStreamsNormalize(vertexStreams & streams)
+{
+	float * nx = vertexStreamsComponent(streams, vertexNormalX);
+	float * ny = vertexStreamsComponent(streams, vertexNormalY);
+	float * nz = vertexStreamsComponent(streams, vertexNormalZ);
+	const vsFloat one = vsSet(1.0f);
+	for (size_t i = 0; i < streams.count; i += vsWidth){
+		vsFloat x = vsLoad(nx + i), y = vsLoad(ny + i), z = vsLoad(nz + i);
+		vsFloat length2 = vsAdd(vsAdd(vsMul(x, x), vsMul(y, y)), vsMul(z, z));
+		vsFloat scale = vsSelectPositive(length2, vsDiv(one, vsSqrt(length2)));
+		vsStore(nx + i, vsMul(x, scale));
+		vsStore(ny + i, vsMul(y, scale));
+		vsStore(nz + i, vsMul(z, scale));
+	}
+}
+
+void vertexStreamsBounds(const vertexStreams & streams, float * lower, float * upper)
+{
+	for (int c = 0; c < 3; ++c){
+		// the padding isn't part of the box, it is left to the scalar loop
+		const float * values = vertexStreamsComponent(streams, vertexPositionX + c);
+		const size_t full = streams.count / vsWidth * vsWidth;
+		vsFloat low = vsSet(std::numeric_limits<float>::max()), high = vsSet(-std::numeric_limits<float>::max());
+		for (size_t i = 0; i < full; i += vsWidth){
+			vsFloat x = vsLoad(values + i);
+			low = vsMin(low, x);
+			high = vsMax(high, x);
+		}
+		float lows[8], highs[8];
+		vsLanes(low, lows);
+		vsLanes(high, highs);
+		lower[c] = *std::min_element(lows, lows + vsWidth);
+		upper[c] = *std::max_element(highs, highs + vsWidth);
+		for (size_t i = full; i < streams.count; ++i){
+			lower[c] = std::min(lower[c], values[i]);
+			upper[c] = std::max(upper[c], values[i]);
+		}
+	}
+}
+
+//
+// Normals
+//
+
+template <typename Work>
+struct vsBands
+{
+	const size_t * borders;
+	Work * work;
+};
+
+template <typename Work>
+static void vsRunBand(size_t band, void * context)
+{
+	const vsBands<Work> & bands = *(const vsBands<Work>*)context;
+	(*bands.work)(bands.borders[band], bands.borders[band + 1]);
+}
+
+// Runs work(first, last) on threadCount bands of count items, through parallelFor if given.
+// Bands hold at least minimumBand items and start at multiples of vsWidth.
+template <typename Work>
+static void vsRunBands(size_t count, size_t minimumBand, unsigned int threadCount, vertexStreamsParallelFor parallelFor, Work work)
+{
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	const size_t bandCount = std::min<size_t>(threadCount, count / minimumBand + 1);
+	std::vector<size_t> borders(bandCount + 1, count);
+	for (size_t band = 0; band < bandCount; ++band)
+		borders[band] = count * band / bandCount / vsWidth * vsWidth;
+
+	vsBands<Work> bands = { borders.data(), &work };
+	if (parallelFor && bandCount > 1){
+		parallelFor(bandCount, vsRunBand<Work>, &bands);
+		return;
+	}
+	std::vector<std::thread> threads;
+	for (size_t band = 1; band < bandCount; ++band)
+		threads.push_back(std::thread(vsRunBand<Work>, band, &bands));
+	vsRunBand<Work>(0, &bands);
+	for (size_t t = 0; t < threads.size(); ++t)
+		threads[t].join();
+}
+
+// Cross product of the triangle edges, its length is twice the triangle area.
+static inline void vsTriangleNormal(const vsFloat * a, const vsFloat * b, const vsFloat * c, vsFloat * n)
+{
+	vsFloat ab[3], ac[3];
+	for (int k = 0; k < 3; ++k){
+		ab[k] = vsSub(b[k], a[k]);
+		ac[k] = vsSub(c[k], a[k]);
+	}
+	n[0] = vsSub(vsMul(ab[1], ac[2]), vsMul(ac[1], ab[2]));
+	n[1] = vsSub(vsMul(ab[2], ac[0]), vsMul(ac[2], ab[0]));
+	n[2] = vsSub(vsMul(ab[0], ac[1]), vsMul(ac[0], ab[1]));
+}
+
+static inline vsFloat vsDot(const vsFloat * a, const vsFloat * b)
+{
+	return vsAdd(vsAdd(vsMul(a[0], b[0]), vsMul(a[1], b[1])), vsMul(a[2], b[2]));
+}
+
+static inline void vsNormalize(vsFloat * v)
+{
+	vsFloat length2 = vsDot(v, v);
+	vsFloat scale = vsSelectPositive(length2, vsDiv(vsSet(1.0f), vsSqrt(length2)));
+	for (int k = 0; k < 3; ++k)
+		v[k] = vsMul(v[k], scale);
+}
+
+// acos with an absolute error below 2e-8 (Abramowitz and Stegun 4.4.46)
+static inline vsFloat vsAcos(vsFloat x)
+{
+	static const float coefficients[8] = {
+		-0.0012624911f, 0.0066700901f, -0.0170881256f, 0.0308918810f,
+		-0.0501743046f, 0.0889789874f, -0.2145988016f, 1.5707963050f
+	};
+	vsFloat a = vsAbs(x);
+	vsFloat p = vsSet(coefficients[0]);
+	for (int i = 1; i < 8; ++i)
+		p = vsAdd(vsMul(p, a), vsSet(coefficients[i]));
+	vsFloat angle = vsMul(vsSqrt(vsSub(vsSet(1.0f), a)), p);
+	return vsSelectNegative(x, vsSub(vsSet(3.14159265f), angle), angle);
+}
+
+// Angle at the corner from which the edges u and v start, zero length edges give a right angle.
+static inline vsFloat vsCornerAngle(const vsFloat * u, const vsFloat * v)
+{
+	const vsFloat one = vsSet(1.0f);
+	vsFloat lengths = vsMul(vsDot(u, u), vsDot(v, v));
+	vsFloat cosine = vsMul(vsDot(u, v), vsSelectPositive(lengths, vsDiv(one, vsSqrt(lengths))));
+	return vsAcos(vsMax(vsMin(cosine, one), vsSet(-1.0f)));
+}
+
+// Flat normals of vsWidth triangles, positions and normals point at the first corner of the first triangle.
+static inline void vsFlatNormalsBatch(const float * const * positions, float * const * normals)
+{
+	vsFloat corners[3][3], n[3];
+	for (int c = 0; c < 3; ++c)
+		vsLoadCorners(positions[c], corners[c]);
+	vsFloat a[3] = { corners[0][0], corners[1][0], corners[2][0] };
+	vsFloat b[3] = { corners[0][1], corners[1][1], corners[2][1] };
+	vsFloat d[3] = { corners[0][2], corners[1][2], corners[2][2] };
+	vsTriangleNormal(a, b, d, n);
+	vsNormalize(n);
+	for (int c = 0; c < 3; ++c)
+		vsStoreCorners(normals[c], n[c]);
+}
+
+void vertexStreamsFlatNormals(vertexStreams & streams, unsigned int threadCount, vertexStreamsParallelFor parallelFor)
+{
+	const size_t triangleCount = streams.count / 3;
+	float * positions[3], * normals[3];
+	for (int c = 0; c < 3; ++c){
+		positions[c] = vertexStreamsComponent(streams, vertexPositionX + c);
+		normals[c] = vertexStreamsComponent(streams, vertexNormalX + c);
+	}
+
+	vsRunBands(triangleCount, 16384, threadCount, parallelFor, [&](size_t first, size_t last){
+		size_t t = first;
+		for (; t + vsWidth <= last; t += vsWidth){
+			const float * p[3] = { positions[0] + 3 * t, positions[1] + 3 * t, positions[2] + 3 * t };
+			float * n[3] = { normals[0] + 3 * t, normals[1] + 3 * t, normals[2] + 3 * t };
+			vsFlatNormalsBatch(p, n);
+		}
+		if (t == last)
+			return;
+
+		// the last triangles run through a zero padded copy, a full batch would read past the arrays
+		alignas(32) float local[6][24] = {};
+		const size_t values = 3 * (last - t);
+		const float * p[3] = { local[0], local[1], local[2] };
+		float * n[3] = { local[3], local[4], local[5] };
+		for (int c = 0; c < 3; ++c)
+			memcpy(local[c], positions[c] + 3 * t, values * sizeof(float));
+		vsFlatNormalsBatch(p, n);
+		for (int c = 0; c < 3; ++c)
+			memcpy(normals[c] + 3 * t, local[3 + c], values * sizeof(float));
+	});
+}
+
+// Weighted normals of the three corners of vsWidth triangles, stored at the triangle index in
+// cornerNormals[3 * corner + component]. With area weighting all corners share the same normal,
+// which is only stored for the first corner.
+static inline void vsCornerNormalsBatch(
+	const float * const * positions, const unsigned int * indices, vertexNormalWeighting weighting,
+	float * const * cornerNormals, size_t triangle
+){
+	vsFloat p[3][3], n[3];
+	for (int k = 0; k < 3; ++k)
+		for (int c = 0; c < 3; ++c)
+			p[k][c] = vsGather(positions[c], indices + k);
+	vsTriangleNormal(p[0], p[1], p[2], n);
+	if (weighting == vertexNormalsArea){
+		for (int c = 0; c < 3; ++c)
+			vsStore(cornerNormals[c] + triangle, n[c]);
+		return;
+	}
+
+	vsNormalize(n);
+	for (int k = 0; k < 3; ++k){
+		const vsFloat * next = p[(k + 1) % 3];
+		const vsFloat * previous = p[(k + 2) % 3];
+		vsFloat u[3], v[3];
+		for (int c = 0; c < 3; ++c){
+			u[c] = vsSub(next[c], p[k][c]);
+			v[c] = vsSub(previous[c], p[k][c]);
+		}
+		vsFloat angle = vsCornerAngle(u, v);
+		for (int c = 0; c < 3; ++c)
+			vsStore(cornerNormals[3 * k + c] + triangle, vsMul(n[c], angle));
+	}
+}
+
+void vertexStreamsSmoothNormals(
+	vertexStreams & streams,
+	const unsigned int * indices,
+	size_t indexCount,
+	vertexNormalWeighting weighting,
+	unsigned int threadCount,
+	vertexStreamsParallelFor parallelFor
+){
+	const size_t triangleCount = indexCount / 3;
+	const size_t capacity = (triangleCount + 7) & ~(size_t)7;
+	const int cornerCount = weighting == vertexNormalsArea ? 1 : 3;
+	float * scratch = vsAllocate(std::max<size_t>(capacity, 8) * 3 * cornerCount);
+	if (!scratch)
+		return;
+	float * cornerNormals[9];
+	for (int i = 0; i < 3 * cornerCount; ++i)
+		cornerNormals[i] = scratch + i * capacity;
+	const float * positions[3];
+	for (int c = 0; c < 3; ++c)
+		positions[c] = vertexStreamsComponent(streams, vertexPositionX + c);
+
+	// face and corner weights in parallel, the arrays are padded so the last batch can be stored whole
+	vsRunBands(triangleCount, 16384, threadCount, parallelFor, [&](size_t first, size_t last){
+		size_t t = first;
+		for (; t + vsWidth <= last; t += vsWidth)
+			vsCornerNormalsBatch(positions, indices + 3 * t, weighting, cornerNormals, t);
+		if (t < last){
+			unsigned int local[24] = {};
+			memcpy(local, indices + 3 * t, 3 * (last - t) * sizeof(unsigned int));
+			vsCornerNormalsBatch(positions, local, weighting, cornerNormals, t);
+		}
+	});
+
+	// sum around the vertices in index order, so the result doesn't depend on the thread count
+	float * normals[3];
+	for (int c = 0; c < 3; ++c){
+		normals[c] = vertexStreamsComponent(streams, vertexNormalX + c);
+		memset(normals[c], 0, streams.capacity * sizeof(float));
+	}
+	for (size_t t = 0; t < triangleCount; ++t){
+		for (int k = 0; k < 3; ++k){
+			const unsigned int index = indices[3 * t + k];
+			const int corner = k < cornerCount ? k : 0;
+			for (int c = 0; c < 3; ++c)
+				normals[c][index] += cornerNormals[3 * corner + c][t];
+		}
+	}
+	vsFree(scratch);
+
+	vertexStreamsNormalize(streams);
+}
+
+#endif
+
+#endif
@@ -8,14 +8,34 @@ in vec2 vertexTexcoord;
 in vec3 vertexNormal;
 in vec3 vertexColor;
 
+#ifdef INSTANCED
+// Scale in w and offset of the instance, vertex colors are scaled and offset the same way
+in vec4 instanceOffset;
+in vec3 instanceColor;
+#endif
+
 // Output data, will be interpolated for each fragment.
 out vec2 fragmentTexcoord;
 out vec3 fragmentNormal;
 out vec3 fragmentColor;
 
+#ifdef FLAT_NORMALS
+// Model space position for normals computed per fragment
+out vec3 fragmentPosition;
+#endif
+
 void main() {
-    gl_Position = MVP * vec4(vertexPosition, 1.0);
+#ifdef INSTANCED
+    vec3 position = instanceOffset.xyz + vertexPosition * instanceOffset.w;
+	fragmentColor = instanceColor + vertexColor * instanceOffset.w;
+#else
+    vec3 position = vertexPosition;
+	fragmentColor = vertexColor;
+#endif
+    gl_Position = MVP * vec4(position, 1.0);
+#ifdef FLAT_NORMALS
+	fragmentPosition = position;
+#endif
 	fragmentTexcoord = vertexTexcoord;
 	fragmentNormal = vertexNormal;
-	fragmentColor = vertexColor;
 }
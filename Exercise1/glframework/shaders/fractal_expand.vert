@@ -0,0 +1,29 @@
+#version 150
+
+// Expands each tetrahedron of the last split level into the 12 vertices of its faces, drawn as
+// 12 points per instance with transform feedback. The outputs match the vertex struct.
+
+uniform vec3 corners[4];
+uniform vec3 cornerColors[4];
+uniform vec3 faceNormals[4];
+
+// Tetrahedron, scale in w
+in vec4 instanceOffset;
+in vec3 instanceColor;
+
+// Captured vertex
+out vec3 position;
+out vec2 texcoord;
+out vec3 normal;
+out vec3 color;
+
+// corners of the four faces, counter clockwise seen from outside
+const int faceCorners[12] = int[12](0, 1, 2, 0, 2, 3, 0, 3, 1, 1, 3, 2);
+
+void main() {
+    int corner = faceCorners[gl_VertexID];
+    position = instanceOffset.xyz + corners[corner] * instanceOffset.w;
+    texcoord = vec2(0.0);
+    normal = faceNormals[gl_VertexID / 3];
+    color = instanceColor + cornerColors[corner] * instanceOffset.w;
+}
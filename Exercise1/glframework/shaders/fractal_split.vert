@@ -0,0 +1,22 @@
+#version 150
+
+// One split level of the fractal tetrahedron, drawn as 4 points per instance with transform feedback.
+// Child j of a tetrahedron with offset o and scale s has the offset o + 0.5 * s * corners[j] and the
+// scale 0.5 * s, colors follow the same recurrence.
+
+uniform vec3 corners[4];
+uniform vec3 cornerColors[4];
+
+// Parent tetrahedron, scale in w
+in vec4 instanceOffset;
+in vec3 instanceColor;
+
+// Captured child tetrahedron
+out vec4 childOffset;
+out vec3 childColor;
+
+void main() {
+    float scale = instanceOffset.w * 0.5;
+    childOffset = vec4(instanceOffset.xyz + corners[gl_VertexID] * scale, scale);
+    childColor = instanceColor + cornerColors[gl_VertexID] * scale;
+}
@@ -0,0 +1,12 @@
+#ifndef LIGHTING_GLSL
+#define LIGHTING_GLSL
+
+// Directional light with a constant ambient term.
+const vec3 lightDir = normalize(vec3(0.2f, 1.0f, 0.4f));
+
+vec3 applyLighting(vec3 color, vec3 normal) {
+    float cosang = clamp(dot(normalize(normal), lightDir), 0.0f, 1.0f);
+    return color * (cosang * 0.8 + 0.2);
+}
+
+#endif
@@ -0,0 +1,37 @@
+// Fragment shader body shared by all surface permutations.
+//   UNLIT         outputs the color without lighting
+//   TEXTURED      multiplies the vertex color with texture1
+//   FLAT_NORMALS  lights each triangle with its face normal from the position derivatives,
+//                 for meshes that share vertices between faces
+
+#include "lighting.glsl"
+
+// Interpolated values from the vertex shaders
+in vec2 fragmentTexcoord;
+in vec3 fragmentNormal;
+in vec3 fragmentColor;
+
+#ifdef FLAT_NORMALS
+in vec3 fragmentPosition;
+#endif
+
+#ifdef TEXTURED
+uniform sampler2D texture1;
+#endif
+
+out vec4 Color;
+
+void main() {
+    vec3 color = fragmentColor;
+#ifdef TEXTURED
+    color *= texture(texture1, fragmentTexcoord).rgb;
+#endif
+#ifdef UNLIT
+    Color = vec4(color, 1.0);
+#elif defined(FLAT_NORMALS)
+    // screen space derivatives span the triangle, counter clockwise triangles face the viewer
+    Color = vec4(applyLighting(color, cross(dFdx(fragmentPosition), dFdy(fragmentPosition))), 1.0);
+#else
+    Color = vec4(applyLighting(color, fragmentNormal), 1.0);
+#endif
+}
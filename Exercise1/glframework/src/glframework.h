@@ -4,6 +4,48 @@
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 
+#define FILEIO_IMPLEMENTATION
+#include <fileio.h>
+
+#define OBJLOADER_IMPLEMENTATION
+#include <objloader.h>
+
+#define MIPMAP_IMPLEMENTATION
+#include <mipmap.h>
+
+#define BCENC_IMPLEMENTATION
+#include <bcenc.h>
+
+#define VERTEXSTREAMS_IMPLEMENTATION
+#include <vertexstreams.h>
+
+// EXT_texture_compression_s3tc is not part of the generated loader
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// neither is ARB_get_program_binary, its entry points are loaded in init
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_PROGRAM_BINARY_FORMATS
+#define GL_PROGRAM_BINARY_FORMATS 0x87FF
+#endif
+
+// KHR_parallel_shader_compile and its ARB predecessor share this enum
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
 namespace glframework
 {
     struct texture
@@ -13,13 +55,59 @@ namespace glframework
         GLint height;
     };
 
+    struct mesh
+    {
+        std::vector<vertex> vertices;
+        std::vector<GLuint> indices;
+    };
+
+    // indexed mesh mapped straight from a binary mesh cache file
+    struct cachedMesh
+    {
+        fileMapping file;
+        const vertex* vertices;
+        GLuint vertexCount;
+        const void* indices;
+        GLuint indexCount;
+        GLenum indexType;
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+    };
+
+    // image with its full mip chain, mapped from the texture cache or freshly decoded.
+    // format is GL_RGBA8 or one of the S3TC formats, levels are stored one after another.
+    struct textureLevels
+    {
+        fileMapping file;
+        std::vector<unsigned char> decoded;
+        const unsigned char* data;
+        int width;
+        int height;
+        GLenum format;
+    };
+
+    // preprocessor definitions of a shader permutation, "NAME" or "NAME VALUE"
+    typedef std::vector<std::string> shaderDefines;
+
     //
     // Data Loading Functions
     //
 
-    static const char* loadShaderSource(char const* path);
+    static bool loadShaderSource(char const* path, fileArena& arena, const char** source, size_t* size);
+    static bool preprocessShaderSource(char const* path, const shaderDefines& defines, std::string& source, std::vector<std::string>* files);
     static unsigned char* loadImageData(char const* path, int* width, int* height);
     static std::vector<vertex> loadOBJVertices(char const* path);
+    static mesh loadOBJMesh(char const* path);
+    static bool loadMeshCache(char const* sourcePath, cachedMesh& cached);
+    static bool writeMeshCache(char const* sourcePath, const mesh& source);
+    static void releaseMeshCache(cachedMesh& cached);
+    static bool loadTextureLevels(char const* path, textureLevels& levels);
+    static void releaseTextureLevels(textureLevels& levels);
+    static uint64_t programCacheKey(const char* vertexSource, const char* fragmentSource);
+    static void setProgramBinaryRetrievable(GLuint program);
+    static GLuint loadProgramBinary(uint64_t key);
+    static bool writeProgramBinary(uint64_t key, GLuint program);
+    static bool isProgramReady(GLuint program);
 
     //
     // Framework Interface Functions
@@ -31,6 +119,90 @@ namespace glframework
     void endFrame();
     bool isRunning();
     void getWindowSize(int* width, int* height);
+
+    //
+    // Asynchronous Loading Functions
+    //
+
+    // runs the job on a worker thread, jobs must not call GL functions
+    void queueJob(std::function<void()> job);
+    // runs the upload on the main thread at the beginning of the next frames. The budget is checked between uploads,
+    // so work that takes longer than a frame should be queued as several uploads.
+    void queueUpload(std::function<void()> upload);
+    // limits the time beginFrame spends on uploads, at least one upload runs per frame
+    void setUploadBudget(double milliseconds);
+    // runs work(0) to work(count - 1) on the worker threads and the calling thread and returns once all have finished.
+    // The calling thread takes its share of the items, so jobs may call this as well.
+    void runParallel(size_t count, std::function<void(size_t)> work);
+    // runParallel in the form of the parallel for callbacks of the mip, block compression and vertex stream headers
+    static void runParallelFor(size_t count, void (*work)(size_t item, void* context), void* context);
+
+    //
+    // File Watching Functions
+    //
+
+    // calls onChanged on the main thread at the beginning of the frame after the file was written
+    void watchFile(const char* path, std::function<void()> onChanged);
+
+    //
+    // Shader Reflection Functions
+    //
+
+    struct shaderVariable
+    {
+        uint32_t name;          // interned name, arrays without the [0] suffix
+        GLint location;
+        GLenum type;
+        GLint size;             // number of array elements
+        uint32_t valueOffset;   // last uploaded value in shaderReflection::values
+        uint32_t valueSize;
+        bool uploaded;
+    };
+
+    struct shaderBlock
+    {
+        uint32_t name;
+        GLuint index;
+        GLint dataSize;
+    };
+
+    // active uniforms, attributes and uniform blocks of a linked program. uniforms and
+    // attributes are open addressing hash tables indexed by name, empty slots have name 0
+    struct shaderReflection
+    {
+        GLuint program;
+        std::vector<shaderVariable> uniforms;
+        std::vector<shaderVariable> attributes;
+        std::vector<shaderBlock> blocks;
+        std::vector<unsigned char> values;
+    };
+
+    struct uniformStatistics
+    {
+        uint64_t issued;
+        uint64_t skipped;
+    };
+
+    // equal strings always map to the same ID, 0 is never returned
+    uint32_t internString(const char* string);
+    const char* internedString(uint32_t id);
+
+    // enumerates the program once after linking, later calls return the same reflection until it is released
+    shaderReflection* reflectProgram(GLuint program);
+    void releaseProgramReflection(GLuint program);
+    const shaderVariable* findUniform(const shaderReflection& reflection, uint32_t name);
+    const shaderVariable* findAttribute(const shaderReflection& reflection, uint32_t name);
+    const shaderBlock* findUniformBlock(const shaderReflection& reflection, uint32_t name);
+
+    // the program has to be in use, values equal to the last upload to the program are skipped
+    void setUniform(shaderReflection& reflection, uint32_t name, GLint value);
+    void setUniform(shaderReflection& reflection, uint32_t name, float value);
+    void setUniform(shaderReflection& reflection, uint32_t name, const glm::vec2& value);
+    void setUniform(shaderReflection& reflection, uint32_t name, const glm::vec3& value);
+    void setUniform(shaderReflection& reflection, uint32_t name, const glm::vec4& value);
+    void setUniform(shaderReflection& reflection, uint32_t name, const glm::mat3& value);
+    void setUniform(shaderReflection& reflection, uint32_t name, const glm::mat4& value);
+    uniformStatistics getUniformStatistics();
 }
 
 //
@@ -38,15 +210,26 @@ namespace glframework
 //
 
 #include <iostream>
-#include <fstream>
-#include <sstream>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <unordered_map>
+
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <direct.h>
+#endif
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
-#define OBJLOADER_IMPLEMENTATION
-#include <objloader.h>
-
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
@@ -56,36 +239,528 @@ namespace glframework
 
 namespace glframework
 {
+    typedef void (GLAD_API_PTR *getProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+    typedef void (GLAD_API_PTR *programBinaryProc)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+    typedef void (GLAD_API_PTR *programParameteriProc)(GLuint program, GLenum pname, GLint value);
+    typedef void (GLAD_API_PTR *maxShaderCompilerThreadsProc)(GLuint count);
+
+    struct watchedFile
+    {
+        std::string directory;
+        std::string name;
+        int watch;
+        time_t modified;
+        off_t size;
+        std::function<void()> onChanged;
+    };
+
     static struct {
         GLFWwindow* window;
         bool mouseDown;
         glm::vec2 mousePos;
         glm::vec3 cameraPos;
+
+        // worker threads and main thread upload queue for asynchronous loading
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()>> jobs;
+        std::mutex jobMutex;
+        std::condition_variable jobAvailable;
+        bool stopWorkers;
+        std::deque<std::function<void()>> uploads;
+        std::mutex uploadMutex;
+        double uploadBudget;
+
+        // textures are block compressed when the driver supports S3TC
+        bool textureCompression;
+
+        // ARB_get_program_binary entry points, NULL when unsupported
+        getProgramBinaryProc getProgramBinary;
+        programBinaryProc programBinary;
+        programParameteriProc programParameteri;
+
+        // shaders compile in driver threads and are only waited for when the status is queried
+        bool parallelShaderCompile;
+
+        // files are watched with inotify where available, otherwise their modification times are polled
+        std::vector<watchedFile> watchedFiles;
+        int fileNotify;
+        double filePollTime;
+
+        // interned strings and reflections of linked programs
+        std::unordered_map<std::string, uint32_t> internedIDs;
+        std::vector<std::string> internedStrings;
+        std::unordered_map<GLuint, shaderReflection> reflections;
+        uniformStatistics uniformUploads;
     } globalState;
 
-    static const char* loadShaderSource(char const* path)
+    // reads the zero terminated source into the arena, it stays valid until the arena is released
+    static bool loadShaderSource(char const* path, fileArena& arena, const char** source, size_t* size)
     {
-        std::ifstream inputStream(path);
-        if (!inputStream.is_open()) {
+        if (!fileRead(path, arena, source, size)) {
             std::cerr << "Could not read file " << path << ". File does not exist." << std::endl;
-            return "";
+            return false;
+        }
+        return true;
+    }
+
+    static bool preprocessShaderFile(const std::string& path, const shaderDefines& defines, int depth, fileArena& arena, std::string& source, std::vector<std::string>& files)
+    {
+        if (depth > 16)
+        {
+            std::cerr << "Could not preprocess " << path << ". Includes are nested too deeply." << std::endl;
+            return false;
         }
-        std::stringstream buffer;
-        buffer << inputStream.rdbuf();
-        std::string sourceStr = buffer.str();
-        char* source = new char[sourceStr.length() + 1];
-        strcpy(source, sourceStr.c_str());
-        return source;
+        const char* text;
+        size_t size;
+        if (!loadShaderSource(path.c_str(), arena, &text, &size))
+            return false;
+
+        // #line directives keep compiler messages pointing at the original lines, the
+        // source string number of a file is its index in files
+        std::string fileIndex = std::to_string(files.size());
+        files.push_back(path);
+        size_t separator = path.find_last_of("/\\");
+        std::string directory = separator == std::string::npos ? "" : path.substr(0, separator + 1);
+        bool definesInserted = depth > 0;
+        if (depth > 0)
+            source += "#line 1 " + fileIndex + "\n";
+
+        // lines are appended straight from the loaded file
+        const char* end = text + size;
+        int lineNumber = 0;
+        for (const char* line = text; line < end; line = std::min(end, line + 1))
+        {
+            const char* lineEnd = std::find(line, end, '\n');
+            const char* start = line;
+            while (start < lineEnd && (*start == ' ' || *start == '\t'))
+                ++start;
+            bool directive = lineEnd - start >= 8;
+            ++lineNumber;
+            if (directive && memcmp(start, "#version", 8) == 0)
+            {
+                // #version has to stay the first line, included files must not repeat it
+                if (depth == 0)
+                {
+                    source.append(line, lineEnd).append("\n");
+                    for (const std::string& define : defines)
+                        source += "#define " + define + "\n";
+                    source += "#line " + std::to_string(lineNumber + 1) + " " + fileIndex + "\n";
+                    definesInserted = true;
+                }
+                else
+                {
+                    source += "\n";
+                }
+            }
+            else if (directive && memcmp(start, "#include", 8) == 0)
+            {
+                const char* open = std::find(start + 8, lineEnd, '"');
+                const char* close = open == lineEnd ? lineEnd : std::find(open + 1, lineEnd, '"');
+                if (close == lineEnd)
+                {
+                    std::cerr << path << "(" << lineNumber << "): #include expects \"file\"" << std::endl;
+                    return false;
+                }
+                if (!preprocessShaderFile(directory + std::string(open + 1, close), defines, depth + 1, arena, source, files))
+                    return false;
+                source += "#line " + std::to_string(lineNumber + 1) + " " + fileIndex + "\n";
+            }
+            else
+            {
+                source.append(line, lineEnd).append("\n");
+            }
+            line = lineEnd;
+        }
+
+        // without #version the defines go to the very beginning
+        if (!definesInserted)
+        {
+            std::string header;
+            for (const std::string& define : defines)
+                header += "#define " + define + "\n";
+            source = header + "#line 1 " + fileIndex + "\n" + source;
+        }
+        return true;
+    }
+
+    // resolves #include "file" relative to the including file and inserts the defines after #version,
+    // files receives every file the source was built from
+    static bool preprocessShaderSource(char const* path, const shaderDefines& defines, std::string& source, std::vector<std::string>* files)
+    {
+        std::vector<std::string> includedFiles;
+        fileArena arena = {};
+        source.clear();
+        bool res = preprocessShaderFile(path, defines, 0, arena, source, includedFiles);
+        fileArenaRelease(arena);
+        if (files)
+            files->insert(files->end(), includedFiles.begin(), includedFiles.end());
+        return res;
     }
 
+    // decodes straight from the mapped file, the result has to be released with free
     static unsigned char* loadImageData(char const* path, int* width, int* height)
     {
-        stbi_set_flip_vertically_on_load(true);
-        unsigned char* data = stbi_load(path, width, height, 0, 4);
+        fileMapping file;
+        if (!fileMap(path, file))
+            return NULL;
+        stbi_set_flip_vertically_on_load_thread(true);
+        unsigned char* data = stbi_load_from_memory((const stbi_uc*)file.data, (int)file.size, width, height, 0, 4);
+        fileUnmap(file);
         return data;
     }
 
-    texture loadTexture(const char* filename)
+    static std::vector<vertex> loadOBJVertices(char const* path)
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> texcoords;
+        std::vector<glm::vec3> normals; // Won't be used at the moment.
+        bool res = loadOBJ(path, positions, texcoords, normals);
+        if (!res) return {};
+
+        std::vector<vertex> vertices(positions.size());
+        for (size_t i = 0; i < vertices.size(); ++i)
+        {
+            vertices[i].position = positions[i];
+            vertices[i].texcoord = texcoords[i];
+            vertices[i].normal = normals[i];
+            vertices[i].color =  glm::vec3(0);
+        }
+
+        return vertices;
+    }
+
+    static mesh loadOBJMesh(char const* path)
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> texcoords;
+        std::vector<glm::vec3> normals;
+        mesh result;
+        bool res = loadOBJIndexed(path, positions, texcoords, normals, result.indices);
+        if (!res) return {};
+
+        result.vertices.resize(positions.size());
+        for (size_t i = 0; i < result.vertices.size(); ++i)
+        {
+            result.vertices[i].position = positions[i];
+            result.vertices[i].texcoord = texcoords[i];
+            result.vertices[i].normal = normals[i];
+            result.vertices[i].color = glm::vec3(0);
+        }
+
+        // files without normals get smooth normals weighted by the corner angles
+        bool hasNormals = std::any_of(normals.begin(), normals.end(), [](const glm::vec3& normal) { return normal != glm::vec3(0); });
+        if (!hasNormals && !result.indices.empty())
+        {
+            vertexStreams streams{};
+            if (vertexStreamsAllocate(streams, result.vertices.size()))
+            {
+                vertexStreamsFromInterleaved((const float*)result.vertices.data(), result.vertices.size(), streams);
+                vertexStreamsSmoothNormals(streams, result.indices.data(), result.indices.size(), vertexNormalsAngle, 0, runParallelFor);
+                vertexStreamsToInterleaved(streams, (float*)result.vertices.data());
+            }
+            vertexStreamsRelease(streams);
+        }
+
+        // compare against one expanded vertex per face corner as returned by loadOBJVertices
+        size_t indexSize = result.vertices.size() <= 65536 ? sizeof(GLushort) : sizeof(GLuint);
+        size_t expandedBytes = result.indices.size() * sizeof(vertex);
+        size_t indexedBytes = result.vertices.size() * sizeof(vertex) + result.indices.size() * indexSize;
+        printf("%s: %zu unique vertices for %zu corners, %.2f MB instead of %.2f MB\n", path,
+            result.vertices.size(), result.indices.size(), indexedBytes / 1048576.0, expandedBytes / 1048576.0);
+
+        return result;
+    }
+
+    //
+    // Binary Mesh Cache
+    //
+    // <source>.meshcache holds a header followed by the vertex and index arrays
+    // exactly as they are uploaded. The cache is only used if it was written from
+    // a source file of the same size and modification time, or the same content.
+    //
+
+    static const uint32_t meshCacheVersion = 2;
+
+    struct meshCacheHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t sourceSize;
+        int64_t sourceModified;
+        uint64_t sourceHash;
+        uint32_t vertexSize;
+        uint32_t vertexCount;
+        uint32_t indexSize;
+        uint32_t indexCount;
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+    };
+
+    static std::string meshCachePath(char const* sourcePath)
+    {
+        return std::string(sourcePath) + ".meshcache";
+    }
+
+    // FNV-1a hash, pass the previous result as seed to hash several buffers
+    static uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ull)
+    {
+        uint64_t h = seed;
+        for (size_t i = 0; i < size; ++i)
+            h = (h ^ ((const unsigned char*)data)[i]) * 1099511628211ull;
+        return h;
+    }
+
+    // FNV-1a hash over the whole file content
+    static bool hashFile(char const* path, uint64_t* hash)
+    {
+        fileMapping file;
+        if (!fileMap(path, file))
+            return false;
+        *hash = hashBytes(file.data, file.size);
+        fileUnmap(file);
+        return true;
+    }
+
+    static bool loadMeshCache(char const* sourcePath, cachedMesh& cached)
+    {
+        struct stat source;
+        if (stat(sourcePath, &source) != 0)
+            return false;
+
+        std::string path = meshCachePath(sourcePath);
+        if (!fileMap(path.c_str(), cached.file))
+            return false;
+
+        const meshCacheHeader* header = (const meshCacheHeader*)cached.file.data;
+        bool valid = cached.file.size >= sizeof(meshCacheHeader) &&
+            memcmp(header->magic, "GLFM", 4) == 0 &&
+            header->version == meshCacheVersion &&
+            header->vertexSize == sizeof(vertex) &&
+            (header->indexSize == sizeof(GLushort) || header->indexSize == sizeof(GLuint)) &&
+            cached.file.size == sizeof(meshCacheHeader) + (uint64_t)header->vertexCount * header->vertexSize + (uint64_t)header->indexCount * header->indexSize &&
+            header->sourceSize == (uint64_t)source.st_size;
+
+        // a touched but unchanged source still matches by content
+        uint64_t sourceHash;
+        if (valid && header->sourceModified != (int64_t)source.st_mtime)
+            valid = hashFile(sourcePath, &sourceHash) && sourceHash == header->sourceHash;
+
+        if (!valid)
+        {
+            fileUnmap(cached.file);
+            return false;
+        }
+
+        printf("Loading mesh cache %s...\n", path.c_str());
+        cached.vertices = (const vertex*)(cached.file.data + sizeof(meshCacheHeader));
+        cached.vertexCount = header->vertexCount;
+        cached.indices = cached.vertices + header->vertexCount;
+        cached.indexCount = header->indexCount;
+        cached.indexType = header->indexSize == sizeof(GLushort) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        cached.boundsMin = header->boundsMin;
+        cached.boundsMax = header->boundsMax;
+        return true;
+    }
+
+    static bool writeMeshCache(char const* sourcePath, const mesh& source)
+    {
+        struct stat info;
+        meshCacheHeader header{};
+        if (stat(sourcePath, &info) != 0 || !hashFile(sourcePath, &header.sourceHash))
+            return false;
+
+        header.version = meshCacheVersion;
+        header.sourceSize = info.st_size;
+        header.sourceModified = info.st_mtime;
+        header.vertexSize = sizeof(vertex);
+        header.vertexCount = source.vertices.size();
+        header.indexSize = source.vertices.size() <= 65536 ? sizeof(GLushort) : sizeof(GLuint);
+        header.indexCount = source.indices.size();
+        header.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+        header.boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+        for (const auto& v : source.vertices)
+        {
+            header.boundsMin = glm::min(header.boundsMin, v.position);
+            header.boundsMax = glm::max(header.boundsMax, v.position);
+        }
+
+        // written next to the cache and renamed over it, so a concurrent load never maps a partial file
+        std::string path = meshCachePath(sourcePath);
+        std::string temporaryPath(path.size() + fileTemporarySuffixSize, '\0');
+        FILE* file = fileCreateTemporary(path.c_str(), &temporaryPath[0]);
+        if (!file)
+            return false;
+
+        // the magic is written last, so an interrupted write never leaves a valid cache behind
+        bool res = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(source.vertices.data(), sizeof(vertex), source.vertices.size(), file) == source.vertices.size();
+        if (res && header.indexSize == sizeof(GLushort))
+        {
+            std::vector<GLushort> shortIndices(source.indices.begin(), source.indices.end());
+            res = fwrite(shortIndices.data(), sizeof(GLushort), shortIndices.size(), file) == shortIndices.size();
+        }
+        else if (res)
+            res = fwrite(source.indices.data(), sizeof(GLuint), source.indices.size(), file) == source.indices.size();
+        res = res && fseek(file, 0, SEEK_SET) == 0 && fwrite("GLFM", 4, 1, file) == 1;
+        return fileCommitTemporary(file, temporaryPath.c_str(), path.c_str(), res);
+    }
+
+    static void releaseMeshCache(cachedMesh& cached)
+    {
+        fileUnmap(cached.file);
+        cached.vertices = NULL;
+        cached.indices = NULL;
+    }
+
+    //
+    // Textures and Texture Cache
+    //
+    // Decoded images are stored with their full mip chain in cache/<hash>.texcache,
+    // where hash is the hash of the source file content. Warm loads map that file
+    // and upload all levels, skipping both image decoding and glGenerateMipmap.
+    // With S3TC support the levels are stored as BC1, or BC3 for images with alpha.
+    //
+
+    static const char* textureCacheDirectory = "cache";
+    static const uint32_t textureCacheVersion = 3;
+
+    struct textureCacheHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t sourceHash;
+        int32_t width;
+        int32_t height;
+        uint32_t format;
+    };
+
+    static size_t textureLevelSize(GLenum format, int width, int height, int level)
+    {
+        int levelWidth = std::max(1, width >> level);
+        int levelHeight = std::max(1, height >> level);
+        if (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+            return bcCompressedSize(levelWidth, levelHeight, bcFormatBC1);
+        if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+            return bcCompressedSize(levelWidth, levelHeight, bcFormatBC3);
+        return mipLevelSize(width, height, level);
+    }
+
+    static size_t textureChainSize(GLenum format, int width, int height)
+    {
+        size_t size = 0;
+        for (int level = 0; level < mipLevelCount(width, height); ++level)
+            size += textureLevelSize(format, width, height, level);
+        return size;
+    }
+
+    // replaces the RGBA8 chain of levels with its block compressed version
+    static void compressTextureLevels(textureLevels& levels)
+    {
+        bool opaque = true;
+        const unsigned char* image = levels.decoded.data();
+        for (size_t i = 3; i < mipLevelSize(levels.width, levels.height, 0) && opaque; i += 4)
+            opaque = image[i] == 255;
+        levels.format = opaque ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+
+        std::vector<unsigned char> compressed(textureChainSize(levels.format, levels.width, levels.height));
+        unsigned char* out = compressed.data();
+        for (int i = 0; i < mipLevelCount(levels.width, levels.height); ++i)
+        {
+            bcCompressImage(image, std::max(1, levels.width >> i), std::max(1, levels.height >> i),
+                opaque ? bcFormatBC1 : bcFormatBC3, out, 0, runParallelFor);
+            image += mipLevelSize(levels.width, levels.height, i);
+            out += textureLevelSize(levels.format, levels.width, levels.height, i);
+        }
+        levels.decoded.swap(compressed);
+    }
+
+    static std::string textureCachePath(uint64_t sourceHash)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.texcache", (unsigned long long)sourceHash);
+        return textureCacheDirectory + std::string(name);
+    }
+
+    static void createCacheDirectory(const char* directory)
+    {
+#if defined(_WIN32)
+        _mkdir(directory);
+#else
+        mkdir(directory, 0755);
+#endif
+    }
+
+    static bool loadTextureLevels(char const* path, textureLevels& levels)
+    {
+        levels.file = fileMapping{};
+        levels.data = NULL;
+        levels.format = GL_RGBA8;
+
+        uint64_t sourceHash;
+        if (!hashFile(path, &sourceHash))
+            return false;
+
+        // warm load: map the cached mip chain
+        std::string cachePath = textureCachePath(sourceHash);
+        if (fileMap(cachePath.c_str(), levels.file))
+        {
+            const textureCacheHeader* header = (const textureCacheHeader*)levels.file.data;
+            if (levels.file.size >= sizeof(textureCacheHeader) &&
+                memcmp(header->magic, "GLFT", 4) == 0 &&
+                header->version == textureCacheVersion &&
+                header->sourceHash == sourceHash &&
+                header->width > 0 && header->height > 0 &&
+                (header->format != GL_RGBA8) == globalState.textureCompression &&
+                levels.file.size == sizeof(textureCacheHeader) + textureChainSize(header->format, header->width, header->height))
+            {
+                levels.width = header->width;
+                levels.height = header->height;
+                levels.format = header->format;
+                levels.data = (const unsigned char*)(header + 1);
+                return true;
+            }
+            fileUnmap(levels.file);
+        }
+
+        // cold load: decode the image and build a gamma correct mip chain on the CPU
+        int width, height;
+        unsigned char* image = glframework::loadImageData(path, &width, &height);
+        if (!image)
+            return false;
+        levels.width = width;
+        levels.height = height;
+        levels.decoded.resize(mipChainSize(width, height));
+        memcpy(levels.decoded.data(), image, mipLevelSize(width, height, 0));
+        free(image);
+        buildMipChain(levels.decoded.data(), width, height, mipColorSRGB, 0, runParallelFor);
+        if (globalState.textureCompression)
+            compressTextureLevels(levels);
+        levels.data = levels.decoded.data();
+
+        // concurrent cold loads of the same image each write a file of their own, the last rename wins
+        createCacheDirectory(textureCacheDirectory);
+        textureCacheHeader header = { { 0, 0, 0, 0 }, textureCacheVersion, sourceHash, width, height, levels.format };
+        std::string temporaryPath(cachePath.size() + fileTemporarySuffixSize, '\0');
+        FILE* file = fileCreateTemporary(cachePath.c_str(), &temporaryPath[0]);
+        if (file)
+        {
+            // the magic is written last, so an interrupted write never leaves a valid cache behind
+            bool res = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                fwrite(levels.data, 1, levels.decoded.size(), file) == levels.decoded.size() &&
+                fseek(file, 0, SEEK_SET) == 0 && fwrite("GLFT", 4, 1, file) == 1;
+            fileCommitTemporary(file, temporaryPath.c_str(), cachePath.c_str(), res);
+        }
+        return true;
+    }
+
+    static void releaseTextureLevels(textureLevels& levels)
+    {
+        fileUnmap(levels.file);
+        std::vector<unsigned char>().swap(levels.decoded);
+        levels.data = NULL;
+    }
+
+    static texture createTexture(const textureLevels& levels)
     {
         // create texture
         GLuint texture;
@@ -100,36 +775,437 @@ namespace glframework
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-        // load texture data and generate mipmaps
-        int width, height;
-        unsigned char* data = glframework::loadImageData(filename, &width, &height);
-        if (data) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-            glGenerateMipmap(GL_TEXTURE_2D);
+        // upload texture data including all mipmaps
+        if (!levels.data)
+            return { texture, 0, 0 };
+        int levelCount = mipLevelCount(levels.width, levels.height);
+        const unsigned char* level = levels.data;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+        for (int i = 0; i < levelCount; ++i)
+        {
+            GLsizei width = std::max(1, levels.width >> i), height = std::max(1, levels.height >> i);
+            GLsizei size = (GLsizei)textureLevelSize(levels.format, levels.width, levels.height, i);
+            if (levels.format == GL_RGBA8)
+                glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, level);
+            else
+                glCompressedTexImage2D(GL_TEXTURE_2D, i, levels.format, width, height, 0, size, level);
+            level += size;
         }
-        free(data);
 
-        return { texture, width, height };
+        return { texture, levels.width, levels.height };
     }
 
-    static std::vector<vertex> loadOBJVertices(char const* path)
+    texture loadTexture(const char* filename)
     {
-        std::vector<glm::vec3> positions;
-        std::vector<glm::vec2> texcoords;
-        std::vector<glm::vec3> normals; // Won't be used at the moment.
-        bool res = loadOBJ("res/cube.obj", positions, texcoords, normals);
-        if (!res) return {};
+        textureLevels levels;
+        loadTextureLevels(filename, levels);
+        texture result = createTexture(levels);
+        releaseTextureLevels(levels);
 
-        std::vector<vertex> vertices(positions.size());
-        for (int i = 0; i < vertices.size(); ++i)
+        return result;
+    }
+
+    // decodes the image on a worker thread and creates the texture during a later frame
+    void loadTextureAsync(const char* filename, std::function<void(texture)> onLoaded)
+    {
+        std::string path = filename;
+        queueJob([path, onLoaded]() {
+            std::shared_ptr<textureLevels> levels = std::make_shared<textureLevels>();
+            loadTextureLevels(path.c_str(), *levels);
+            queueUpload([levels, onLoaded]() {
+                onLoaded(createTexture(*levels));
+                releaseTextureLevels(*levels);
+            });
+        });
+    }
+
+    //
+    // Program Binary Cache
+    //
+    // Linked programs are stored as driver binaries in cache/<key>.progcache, where
+    // key hashes the shader sources together with the driver vendor, renderer and
+    // version. The binary format is stored in the file and has to be one the driver
+    // still accepts, binaries the driver rejects are replaced after the next link.
+    //
+
+    static const char* programCacheDirectory = "cache";
+    static const uint32_t programCacheVersion = 1;
+
+    struct programCacheHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t key;
+        uint32_t binaryFormat;
+        uint32_t binarySize;
+    };
+
+    static std::string programCachePath(uint64_t key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.progcache", (unsigned long long)key);
+        return programCacheDirectory + std::string(name);
+    }
+
+    static uint64_t programCacheKey(const char* vertexSource, const char* fragmentSource)
+    {
+        // the terminating zeros keep the boundaries between the strings in the hash
+        const char* parts[] = {
+            vertexSource, fragmentSource,
+            (const char*)glGetString(GL_VENDOR), (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION)
+        };
+        uint64_t key = hashBytes(&programCacheVersion, sizeof(programCacheVersion));
+        for (const char* part : parts)
+            key = part ? hashBytes(part, strlen(part) + 1, key) : hashBytes("", 1, key);
+        return key;
+    }
+
+    // must be called before glLinkProgram for writeProgramBinary to work on all drivers
+    static void setProgramBinaryRetrievable(GLuint program)
+    {
+        if (globalState.programParameteri)
+            globalState.programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // false while the driver is still compiling or linking the program in the background
+    static bool isProgramReady(GLuint program)
+    {
+        if (!globalState.parallelShaderCompile)
+            return true;
+        GLint completed = GL_TRUE;
+        glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &completed);
+        return completed == GL_TRUE;
+    }
+
+    // returns the linked program or 0 if there is no usable binary
+    static GLuint loadProgramBinary(uint64_t key)
+    {
+        if (!globalState.programBinary)
+            return 0;
+
+        fileMapping file;
+        std::string path = programCachePath(key);
+        if (!fileMap(path.c_str(), file))
+            return 0;
+
+        const programCacheHeader* header = (const programCacheHeader*)file.data;
+        bool valid = file.size >= sizeof(programCacheHeader) &&
+            memcmp(header->magic, "GLFP", 4) == 0 &&
+            header->version == programCacheVersion &&
+            header->key == key &&
+            file.size == sizeof(programCacheHeader) + header->binarySize;
+        if (valid)
         {
-            vertices[i].position = positions[i];
-            vertices[i].texcoord = texcoords[i];
-            vertices[i].normal = normals[i];
-            vertices[i].color =  glm::vec3(0);
+            GLint formatCount = 0;
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+            std::vector<GLint> formats(std::max(formatCount, 1));
+            glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.data());
+            valid = std::find(formats.begin(), formats.begin() + formatCount, (GLint)header->binaryFormat) != formats.begin() + formatCount;
         }
 
-        return vertices;
+        GLuint program = 0;
+        if (valid)
+        {
+            program = glCreateProgram();
+            globalState.programBinary(program, header->binaryFormat, header + 1, header->binarySize);
+            GLint linked = GL_FALSE;
+            glGetProgramiv(program, GL_LINK_STATUS, &linked);
+            if (linked != GL_TRUE)
+            {
+                glDeleteProgram(program);
+                program = 0;
+            }
+        }
+        fileUnmap(file);
+        return program;
+    }
+
+    static bool writeProgramBinary(uint64_t key, GLuint program)
+    {
+        if (!globalState.getProgramBinary)
+            return false;
+
+        GLint binarySize = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binarySize);
+        if (binarySize <= 0)
+            return false;
+        std::vector<char> binary(binarySize);
+        GLenum binaryFormat = 0;
+        globalState.getProgramBinary(program, binarySize, &binarySize, &binaryFormat, binary.data());
+
+        createCacheDirectory(programCacheDirectory);
+        std::string path = programCachePath(key);
+        programCacheHeader header = { { 0, 0, 0, 0 }, programCacheVersion, key, binaryFormat, (uint32_t)binarySize };
+        std::string temporaryPath(path.size() + fileTemporarySuffixSize, '\0');
+        FILE* file = fileCreateTemporary(path.c_str(), &temporaryPath[0]);
+        if (!file)
+            return false;
+
+        // the magic is written last, so an interrupted write never leaves a valid cache behind,
+        // and the rename keeps other instances from mapping a partial binary
+        bool res = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(binary.data(), 1, binarySize, file) == (size_t)binarySize &&
+            fseek(file, 0, SEEK_SET) == 0 && fwrite("GLFP", 4, 1, file) == 1;
+        return fileCommitTemporary(file, temporaryPath.c_str(), path.c_str(), res);
+    }
+
+    //
+    // Shader Reflection
+    //
+    // Programs are enumerated once after linking. Lookups hash the interned name ID
+    // instead of the string, and every uniform keeps its last uploaded value so
+    // setting an unchanged value does not reach the driver.
+    //
+
+    uint32_t internString(const char* string)
+    {
+        auto interned = globalState.internedIDs.find(string);
+        if (interned != globalState.internedIDs.end())
+            return interned->second;
+        if (globalState.internedStrings.empty())
+            globalState.internedStrings.push_back(""); // ID 0 marks empty table slots
+        uint32_t id = (uint32_t)globalState.internedStrings.size();
+        globalState.internedStrings.push_back(string);
+        globalState.internedIDs[string] = id;
+        return id;
+    }
+
+    const char* internedString(uint32_t id)
+    {
+        return id < globalState.internedStrings.size() ? globalState.internedStrings[id].c_str() : "";
+    }
+
+    static uint32_t shaderTableSlot(uint32_t name, size_t tableSize)
+    {
+        return (name * 2654435761u) & (uint32_t)(tableSize - 1);
+    }
+
+    static void insertShaderVariable(std::vector<shaderVariable>& table, const shaderVariable& variable)
+    {
+        uint32_t slot = shaderTableSlot(variable.name, table.size());
+        while (table[slot].name != 0)
+            slot = (slot + 1) & (uint32_t)(table.size() - 1);
+        table[slot] = variable;
+    }
+
+    static const shaderVariable* findShaderVariable(const std::vector<shaderVariable>& table, uint32_t name)
+    {
+        if (table.empty() || name == 0)
+            return NULL;
+        for (uint32_t slot = shaderTableSlot(name, table.size()); table[slot].name != 0; slot = (slot + 1) & (uint32_t)(table.size() - 1))
+        {
+            if (table[slot].name == name)
+                return &table[slot];
+        }
+        return NULL;
+    }
+
+    // bytes of a single element, 0 for types without a typed setter
+    static uint32_t shaderValueSize(GLenum type)
+    {
+        switch (type)
+        {
+        case GL_FLOAT: case GL_INT: case GL_UNSIGNED_INT: case GL_BOOL:
+            return 4;
+        case GL_FLOAT_VEC2: return 8;
+        case GL_FLOAT_VEC3: return 12;
+        case GL_FLOAT_VEC4: return 16;
+        case GL_FLOAT_MAT3: return 36;
+        case GL_FLOAT_MAT4: return 64;
+        case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+        case GL_SAMPLER_2D_SHADOW: case GL_SAMPLER_2D_ARRAY: case GL_SAMPLER_BUFFER:
+        case GL_INT_SAMPLER_2D: case GL_UNSIGNED_INT_SAMPLER_2D:
+            return 4;
+        default:
+            return 0;
+        }
+    }
+
+    // hash table with at least twice as many slots as entries
+    static std::vector<shaderVariable> createShaderTable(size_t count)
+    {
+        size_t size = 1;
+        while (size < count * 2)
+            size *= 2;
+        shaderVariable empty = { 0, -1, 0, 0, 0, 0, false };
+        return std::vector<shaderVariable>(size, empty);
+    }
+
+    static std::string shaderVariableName(const GLchar* name)
+    {
+        std::string variable = name;
+        size_t length = variable.size();
+        if (length > 3 && variable.compare(length - 3, 3, "[0]") == 0)
+            variable.resize(length - 3);
+        return variable;
+    }
+
+    shaderReflection* reflectProgram(GLuint program)
+    {
+        if (!program)
+            return NULL;
+        auto existing = globalState.reflections.find(program);
+        if (existing != globalState.reflections.end())
+            return &existing->second;
+
+        shaderReflection& reflection = globalState.reflections[program];
+        reflection.program = program;
+        GLint nameLength = 0, attributeNameLength = 0, blockNameLength = 0;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &nameLength);
+        glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &attributeNameLength);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &blockNameLength);
+        std::vector<GLchar> name(std::max(std::max(nameLength, attributeNameLength), std::max(blockNameLength, 1)));
+
+        // uniforms in the default block, block members have no location
+        GLint uniformCount = 0;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniformCount);
+        std::vector<shaderVariable> uniforms;
+        for (GLint i = 0; i < uniformCount; ++i)
+        {
+            shaderVariable uniform = { 0, -1, 0, 0, 0, 0, false };
+            glGetActiveUniform(program, i, (GLsizei)name.size(), NULL, &uniform.size, &uniform.type, name.data());
+            uniform.location = glGetUniformLocation(program, name.data());
+            if (uniform.location < 0)
+                continue;
+            uniform.name = internString(shaderVariableName(name.data()).c_str());
+            uniform.valueOffset = (uint32_t)reflection.values.size();
+            uniform.valueSize = shaderValueSize(uniform.type);
+            reflection.values.resize(reflection.values.size() + uniform.valueSize);
+            uniforms.push_back(uniform);
+        }
+        reflection.uniforms = createShaderTable(uniforms.size());
+        for (const shaderVariable& uniform : uniforms)
+            insertShaderVariable(reflection.uniforms, uniform);
+
+        GLint attributeCount = 0;
+        glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &attributeCount);
+        reflection.attributes = createShaderTable(attributeCount);
+        for (GLint i = 0; i < attributeCount; ++i)
+        {
+            shaderVariable attribute = { 0, -1, 0, 0, 0, 0, false };
+            glGetActiveAttrib(program, i, (GLsizei)name.size(), NULL, &attribute.size, &attribute.type, name.data());
+            attribute.location = glGetAttribLocation(program, name.data());
+            attribute.name = internString(shaderVariableName(name.data()).c_str());
+            insertShaderVariable(reflection.attributes, attribute);
+        }
+
+        GLint blockCount = 0;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+        for (GLint i = 0; i < blockCount; ++i)
+        {
+            shaderBlock block = { 0, (GLuint)i, 0 };
+            glGetActiveUniformBlockName(program, i, (GLsizei)name.size(), NULL, name.data());
+            glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_DATA_SIZE, &block.dataSize);
+            block.name = internString(name.data());
+            reflection.blocks.push_back(block);
+        }
+        return &reflection;
+    }
+
+    // must be called before the program is deleted, a new program may reuse its name
+    void releaseProgramReflection(GLuint program)
+    {
+        globalState.reflections.erase(program);
+    }
+
+    const shaderVariable* findUniform(const shaderReflection& reflection, uint32_t name)
+    {
+        return findShaderVariable(reflection.uniforms, name);
+    }
+
+    const shaderVariable* findAttribute(const shaderReflection& reflection, uint32_t name)
+    {
+        return findShaderVariable(reflection.attributes, name);
+    }
+
+    const shaderBlock* findUniformBlock(const shaderReflection& reflection, uint32_t name)
+    {
+        for (const shaderBlock& block : reflection.blocks)
+        {
+            if (block.name == name)
+                return &block;
+        }
+        return NULL;
+    }
+
+    // returns the location to upload to, or -1 if the uniform is inactive or already has the value
+    static GLint updateUniformValue(shaderReflection& reflection, uint32_t name, const void* value, uint32_t size)
+    {
+        shaderVariable* uniform = (shaderVariable*)findShaderVariable(reflection.uniforms, name);
+        if (!uniform)
+        {
+            ++globalState.uniformUploads.skipped;
+            return -1;
+        }
+
+        // values of a mismatching type are passed on uncached, so the driver reports the error
+        if (uniform->valueSize == size)
+        {
+            unsigned char* cached = &reflection.values[uniform->valueOffset];
+            if (uniform->uploaded && memcmp(cached, value, size) == 0)
+            {
+                ++globalState.uniformUploads.skipped;
+                return -1;
+            }
+            memcpy(cached, value, size);
+            uniform->uploaded = true;
+        }
+        ++globalState.uniformUploads.issued;
+        return uniform->location;
+    }
+
+    void setUniform(shaderReflection& reflection, uint32_t name, GLint value)
+    {
+        GLint location = updateUniformValue(reflection, name, &value, sizeof(value));
+        if (location >= 0)
+            glUniform1i(location, value);
+    }
+
+    void setUniform(shaderReflection& reflection, uint32_t name, float value)
+    {
+        GLint location = updateUniformValue(reflection, name, &value, sizeof(value));
+        if (location >= 0)
+            glUniform1f(location, value);
+    }
+
+    void setUniform(shaderReflection& reflection, uint32_t name, const glm::vec2& value)
+    {
+        GLint location = updateUniformValue(reflection, name, glm::value_ptr(value), sizeof(value));
+        if (location >= 0)
+            glUniform2fv(location, 1, glm::value_ptr(value));
+    }
+
+    void setUniform(shaderReflection& reflection, uint32_t name, const glm::vec3& value)
+    {
+        GLint location = updateUniformValue(reflection, name, glm::value_ptr(value), sizeof(value));
+        if (location >= 0)
+            glUniform3fv(location, 1, glm::value_ptr(value));
+    }
+
+    void setUniform(shaderReflection& reflection, uint32_t name, const glm::vec4& value)
+    {
+        GLint location = updateUniformValue(reflection, name, glm::value_ptr(value), sizeof(value));
+        if (location >= 0)
+            glUniform4fv(location, 1, glm::value_ptr(value));
+    }
+
+    void setUniform(shaderReflection& reflection, uint32_t name, const glm::mat3& value)
+    {
+        GLint location = updateUniformValue(reflection, name, glm::value_ptr(value), sizeof(value));
+        if (location >= 0)
+            glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(value));
+    }
+
+    void setUniform(shaderReflection& reflection, uint32_t name, const glm::mat4& value)
+    {
+        GLint location = updateUniformValue(reflection, name, glm::value_ptr(value), sizeof(value));
+        if (location >= 0)
+            glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+    }
+
+    uniformStatistics getUniformStatistics()
+    {
+        return globalState.uniformUploads;
     }
 
     static void callbackFunctionError(int error, const char* message)
@@ -181,6 +1257,209 @@ namespace glframework
         fprintf(stderr, "GL Debug Message: %s type = 0x%x, severity = 0x%x, message = %s\n", (type == GL_DEBUG_TYPE_ERROR ? "** GL ERROR **" : ""), type, severity, message);
     }
 
+    static void workerThread()
+    {
+        for (;;)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(globalState.jobMutex);
+                globalState.jobAvailable.wait(lock, [] { return globalState.stopWorkers || !globalState.jobs.empty(); });
+                if (globalState.stopWorkers)
+                    return;
+                job = std::move(globalState.jobs.front());
+                globalState.jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+    // runs queued uploads until the per frame budget is used up,
+    // uploads queued by other uploads run during the next frame
+    static void processUploads()
+    {
+        double start = glfwGetTime();
+        size_t queued;
+        {
+            std::lock_guard<std::mutex> lock(globalState.uploadMutex);
+            queued = globalState.uploads.size();
+        }
+        for (; queued > 0; --queued)
+        {
+            std::function<void()> upload;
+            {
+                std::lock_guard<std::mutex> lock(globalState.uploadMutex);
+                if (globalState.uploads.empty())
+                    return;
+                upload = std::move(globalState.uploads.front());
+                globalState.uploads.pop_front();
+            }
+            upload();
+            if ((glfwGetTime() - start) * 1000.0 >= globalState.uploadBudget)
+                return;
+        }
+    }
+
+    void queueJob(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(globalState.jobMutex);
+            globalState.jobs.push_back(std::move(job));
+        }
+        globalState.jobAvailable.notify_one();
+    }
+
+    void queueUpload(std::function<void()> upload)
+    {
+        std::lock_guard<std::mutex> lock(globalState.uploadMutex);
+        globalState.uploads.push_back(std::move(upload));
+    }
+
+    void setUploadBudget(double milliseconds)
+    {
+        globalState.uploadBudget = milliseconds;
+    }
+
+    // items handed out by runParallel, shared with the helper jobs which may only start after all items are done
+    struct parallelItems
+    {
+        std::mutex mutex;
+        std::condition_variable finished;
+        size_t next;
+        size_t done;
+        size_t count;
+        const std::function<void(size_t)>* work;
+    };
+
+    // runs items until none are left, work is only touched while an item is unfinished and runParallel still waits
+    static void runParallelItems(parallelItems& items)
+    {
+        for (;;)
+        {
+            size_t item;
+            {
+                std::lock_guard<std::mutex> lock(items.mutex);
+                if (items.next == items.count)
+                    return;
+                item = items.next++;
+            }
+            (*items.work)(item);
+            {
+                std::lock_guard<std::mutex> lock(items.mutex);
+                if (++items.done < items.count)
+                    continue;
+            }
+            items.finished.notify_all();
+        }
+    }
+
+    void runParallel(size_t count, std::function<void(size_t)> work)
+    {
+        std::shared_ptr<parallelItems> items = std::make_shared<parallelItems>();
+        items->next = 0;
+        items->done = 0;
+        items->count = count;
+        items->work = &work;
+
+        size_t helpers = std::min(count > 0 ? count - 1 : 0, globalState.workers.size());
+        for (size_t i = 0; i < helpers; ++i)
+            queueJob([items]() { runParallelItems(*items); });
+        runParallelItems(*items);
+
+        std::unique_lock<std::mutex> lock(items->mutex);
+        items->finished.wait(lock, [&] { return items->done == items->count; });
+    }
+
+    static void runParallelFor(size_t count, void (*work)(size_t item, void* context), void* context)
+    {
+        runParallel(count, [work, context](size_t item) { work(item, context); });
+    }
+
+    // modification times only have a resolution of seconds, so the size is compared as well
+    static void fileModificationStamp(const std::string& path, time_t* modified, off_t* size)
+    {
+        struct stat status;
+        bool exists = stat(path.c_str(), &status) == 0;
+        *modified = exists ? status.st_mtime : 0;
+        *size = exists ? status.st_size : 0;
+    }
+
+    void watchFile(const char* path, std::function<void()> onChanged)
+    {
+        // inotify watches directories, so files replaced by editors on save keep being watched
+        std::string fullPath = path;
+        size_t separator = fullPath.find_last_of("/\\");
+        watchedFile file;
+        file.directory = separator == std::string::npos ? "." : fullPath.substr(0, separator);
+        file.name = separator == std::string::npos ? fullPath : fullPath.substr(separator + 1);
+        file.watch = -1;
+        fileModificationStamp(fullPath, &file.modified, &file.size);
+        file.onChanged = onChanged;
+#if defined(__linux__)
+        if (globalState.fileNotify >= 0)
+            file.watch = inotify_add_watch(globalState.fileNotify, file.directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+#endif
+        globalState.watchedFiles.push_back(file);
+    }
+
+    // calls the handlers of changed files, each handler at most once per frame
+    static void pollWatchedFiles()
+    {
+        std::vector<bool> changed(globalState.watchedFiles.size(), false);
+#if defined(__linux__)
+        if (globalState.fileNotify >= 0)
+        {
+            alignas(inotify_event) char buffer[4096];
+            ssize_t size;
+            while ((size = read(globalState.fileNotify, buffer, sizeof(buffer))) > 0)
+            {
+                for (char* event = buffer; event < buffer + size; event += sizeof(inotify_event) + ((inotify_event*)event)->len)
+                {
+                    const inotify_event* notification = (const inotify_event*)event;
+                    for (size_t i = 0; i < globalState.watchedFiles.size(); ++i)
+                    {
+                        const watchedFile& file = globalState.watchedFiles[i];
+                        if (file.watch == notification->wd && notification->len > 0 && file.name == notification->name)
+                            changed[i] = true;
+                    }
+                }
+            }
+        }
+#endif
+
+        // poll files without inotify watch twice per second
+        double time = glfwGetTime();
+        if (time - globalState.filePollTime >= 0.5)
+        {
+            globalState.filePollTime = time;
+            for (size_t i = 0; i < globalState.watchedFiles.size(); ++i)
+            {
+                watchedFile& file = globalState.watchedFiles[i];
+                if (file.watch >= 0)
+                    continue;
+                time_t modified;
+                off_t size;
+                fileModificationStamp(file.directory + "/" + file.name, &modified, &size);
+                if (modified != file.modified || size != file.size)
+                {
+                    file.modified = modified;
+                    file.size = size;
+                    changed[i] = true;
+                }
+            }
+        }
+
+        // handlers may watch further files, so iterate over a copy
+        for (size_t i = 0; i < changed.size(); ++i)
+        {
+            if (changed[i])
+            {
+                std::function<void()> onChanged = globalState.watchedFiles[i].onChanged;
+                onChanged();
+            }
+        }
+    }
+
     bool init(const char *WindowName)
     {
         glfwSetErrorCallback(callbackFunctionError);
@@ -216,13 +1495,63 @@ namespace glframework
         if (glDebugMessageCallback)
             glDebugMessageCallback(debugMessageCallback, 0);
 
+        globalState.textureCompression = glfwExtensionSupported("GL_EXT_texture_compression_s3tc") == GLFW_TRUE;
+        if (glfwExtensionSupported("GL_ARB_get_program_binary"))
+        {
+            globalState.getProgramBinary = (getProgramBinaryProc)glfwGetProcAddress("glGetProgramBinary");
+            globalState.programBinary = (programBinaryProc)glfwGetProcAddress("glProgramBinary");
+            globalState.programParameteri = (programParameteriProc)glfwGetProcAddress("glProgramParameteri");
+        }
+
+        // let the driver compile shaders on its own threads
+        maxShaderCompilerThreadsProc maxShaderCompilerThreads = NULL;
+        if (glfwExtensionSupported("GL_KHR_parallel_shader_compile"))
+            maxShaderCompilerThreads = (maxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+        else if (glfwExtensionSupported("GL_ARB_parallel_shader_compile"))
+            maxShaderCompilerThreads = (maxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+        globalState.parallelShaderCompile = maxShaderCompilerThreads != NULL;
+        if (maxShaderCompilerThreads)
+            maxShaderCompilerThreads(0xFFFFFFFF);
+
+#if defined(__linux__)
+        globalState.fileNotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#else
+        globalState.fileNotify = -1;
+#endif
+        globalState.filePollTime = 0.0;
+
         globalState.cameraPos = glm::vec3(0.0f, 0.0f, 8.0f);
 
+        // keep one core for the render thread
+        unsigned int workerCount = std::max(2u, std::thread::hardware_concurrency()) - 1;
+        globalState.stopWorkers = false;
+        globalState.uploadBudget = 4.0;
+        for (unsigned int i = 0; i < workerCount; ++i)
+            globalState.workers.push_back(std::thread(workerThread));
+
         return true;
     }
 
     void destroy()
     {
+        // finish running jobs and drop everything that is still queued
+        {
+            std::lock_guard<std::mutex> lock(globalState.jobMutex);
+            globalState.stopWorkers = true;
+            globalState.jobs.clear();
+        }
+        globalState.jobAvailable.notify_all();
+        for (auto& worker : globalState.workers)
+            worker.join();
+        globalState.workers.clear();
+        globalState.uploads.clear();
+
+        globalState.watchedFiles.clear();
+#if defined(__linux__)
+        if (globalState.fileNotify >= 0)
+            close(globalState.fileNotify);
+#endif
+
         ImGui_ImplOpenGL3_Shutdown();
         ImGui_ImplGlfw_Shutdown();
         ImGui::DestroyContext();
@@ -235,6 +1564,8 @@ namespace glframework
     void beginFrame()
     {
         glfwPollEvents();
+        pollWatchedFiles();
+        processUploads();
 
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
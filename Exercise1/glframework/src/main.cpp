@@ -4,6 +4,7 @@
 
 #include <array>
 #include <vector>
+#include <map>
 #include <stdio.h>
 
 struct vertex
@@ -14,78 +15,135 @@ struct vertex
     glm::vec3 color;
 };
 
+// per instance attributes, the instance draws the mesh scaled by offset.w and moved by offset.xyz,
+// vertex colors are scaled the same way and moved by color
+struct instance
+{
+    glm::vec4 offset;
+    glm::vec3 color;
+};
+
 #include "glframework.h"
 
 namespace glframework
 {
+    // Storage format of the vertex attributes in the vertex buffer, each attribute is packed on its own.
+    // Packed attributes are normalized integers or half floats, so the shaders see the same inputs as with floats.
+    struct vertexLayout
+    {
+        bool quantizedPositions; // 16 bit snorm in the bounding cube of the mesh, undone by getPositionTransform
+        bool halfTexcoords;      // 16 bit floats
+        bool packedNormals;      // 10_10_10_2 snorm, 8 bit snorm without OpenGL 3.3
+        bool byteColors;         // RGBA8 unorm, colors are clamped to [0, 1]
+    };
+
+    const vertexLayout floatVertexLayout = { false, false, false, false };  // 44 bytes, uploaded without conversion
+    const vertexLayout compactVertexLayout = { false, true, true, true };   // 24 bytes
+    const vertexLayout quantizedVertexLayout = { true, true, true, true };  // 20 bytes
+
     struct vao
     {
         GLuint id;
         GLuint vbo;
         GLuint vertexCount;
+        GLuint ebo;
+        GLuint indexCount;
+        GLenum indexType;
+        GLuint instanceBuffer;
+        GLuint instanceCount;
+        vertexLayout layout;
+        float positionBounds[4]; // center in xyz and half size in w of the cube quantized positions are relative to
     };
 
-    GLuint compileShader(GLuint type, const GLchar* shaderSource)
+    // starts compiling the shader, drivers with parallel shader compilation return immediately
+    GLuint beginCompileShader(GLuint type, const GLchar* shaderSource)
     {
-        // create and compile shader
         GLuint shaderID = glCreateShader(type);
         glShaderSource(shaderID, 1, &shaderSource, 0);
         glCompileShader(shaderID);
+        return shaderID;
+    }
 
-        // check compile success
+    // waits for the compilation and prints the log on failure
+    bool checkShaderCompiled(GLuint shaderID)
+    {
         GLint shaderCompiled = GL_FALSE;
         glGetShaderiv(shaderID, GL_COMPILE_STATUS, &shaderCompiled);
         if (shaderCompiled != GL_TRUE)
         {
             GLint logLength;
             glGetShaderiv(shaderID, GL_INFO_LOG_LENGTH, &logLength);
-            std::vector<GLchar> log(logLength);
+            std::vector<GLchar> log(std::max(logLength, 1));
             glGetShaderInfoLog(shaderID, logLength, &logLength, log.data());
-            glDeleteShader(shaderID);
             std::cout << log.data() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    GLuint compileShader(GLuint type, const GLchar* shaderSource)
+    {
+        // create and compile shader
+        GLuint shaderID = beginCompileShader(type, shaderSource);
+
+        // check compile success
+        if (!checkShaderCompiled(shaderID))
+        {
+            glDeleteShader(shaderID);
             return 0;
         }
 
         return shaderID;
     }
 
-    GLuint linkShaderProgram(GLuint vertexShader, GLuint fragmentShader)
+    // starts linking the shader program, attribute locations have to be bound before linking
+    GLuint beginLinkShaderProgram(GLuint vertexShader, GLuint fragmentShader)
     {
-        if (!vertexShader) return 0;
-        if (!fragmentShader) return 0;
-
-        // link shader program
         GLuint shaderProgramID = glCreateProgram();
         glAttachShader(shaderProgramID, vertexShader);
         glAttachShader(shaderProgramID, fragmentShader);
+        glBindAttribLocation(shaderProgramID, 0, "vertexPosition");
+        glBindAttribLocation(shaderProgramID, 1, "vertexTexcoord");
+        glBindAttribLocation(shaderProgramID, 2, "vertexNormal");
+        glBindAttribLocation(shaderProgramID, 3, "vertexColor");
+        glBindAttribLocation(shaderProgramID, 4, "instanceOffset");
+        glBindAttribLocation(shaderProgramID, 5, "instanceColor");
+        setProgramBinaryRetrievable(shaderProgramID);
         glLinkProgram(shaderProgramID);
+        return shaderProgramID;
+    }
 
-        // check link success
+    // waits for the link and prints the log on failure
+    bool checkShaderProgramLinked(GLuint shaderProgramID)
+    {
         GLint shaderProgramLinked = GL_TRUE;
         glGetProgramiv(shaderProgramID, GL_LINK_STATUS, &shaderProgramLinked);
         if (shaderProgramLinked != GL_TRUE)
         {
             GLint logLength;
             glGetProgramiv(shaderProgramID, GL_INFO_LOG_LENGTH, &logLength);
-            std::vector<GLchar> log(logLength);
+            std::vector<GLchar> log(std::max(logLength, 1));
             glGetProgramInfoLog(shaderProgramID, logLength, &logLength, log.data());
-            glDeleteProgram(shaderProgramID);
             std::cout << log.data() << std::endl;
-            return 0;
+            return false;
         }
+        return true;
+    }
 
-        // set vertex attibute locations and texture units
-        glUseProgram(shaderProgramID);
-        glBindAttribLocation(shaderProgramID, 0, "vertexPosition");
-        glBindAttribLocation(shaderProgramID, 1, "vertexTexcoord");
-        glBindAttribLocation(shaderProgramID, 2, "vertexNormal");
-        glBindAttribLocation(shaderProgramID, 3, "vertexColor");
-        glLinkProgram(shaderProgramID);
-        glUniform1i(glGetUniformLocation(shaderProgramID, "texture1"), 1);
-        glUniform1i(glGetUniformLocation(shaderProgramID, "texture2"), 2);
-        glUniform1i(glGetUniformLocation(shaderProgramID, "texture3"), 3);
-        glUniform1i(glGetUniformLocation(shaderProgramID, "texture4"), 4);
-        glUseProgram(0);
+    GLuint linkShaderProgram(GLuint vertexShader, GLuint fragmentShader)
+    {
+        if (!vertexShader) return 0;
+        if (!fragmentShader) return 0;
+
+        // link shader program
+        GLuint shaderProgramID = beginLinkShaderProgram(vertexShader, fragmentShader);
+
+        // check link success
+        if (!checkShaderProgramLinked(shaderProgramID))
+        {
+            glDeleteProgram(shaderProgramID);
+            return 0;
+        }
 
         // cleanup
         glDetachShader(shaderProgramID, vertexShader);
@@ -94,56 +152,623 @@ namespace glframework
         return shaderProgramID;
     }
 
-    GLuint loadShaderProgram(const char* vertShaderSourceFile, const char* fragShaderSourceFile)
+    void setTextureUnits(GLuint shaderProgramID)
     {
-        // load shader source code
-        const char* vertexShaderSource = loadShaderSource(vertShaderSourceFile);
-        const char* fragmentShaderSource = loadShaderSource(fragShaderSourceFile);
+        static const uint32_t textureNames[] = { internString("texture1"), internString("texture2"), internString("texture3"), internString("texture4") };
+
+        // uniform values are not part of program binaries, so this runs for cached programs as well
+        shaderReflection* reflection = reflectProgram(shaderProgramID);
+        glUseProgram(shaderProgramID);
+        for (GLint unit = 1; unit <= 4; ++unit)
+            setUniform(*reflection, textureNames[unit - 1], unit);
+        glUseProgram(0);
+    }
+
+    // compiles and links the program or loads the driver binary of an earlier run
+    GLuint buildShaderProgram(const std::string& vertexShaderSource, const std::string& fragmentShaderSource, const std::string& name)
+    {
+        double start = glfwGetTime();
+
+        // reuse the driver binary of an earlier run when possible
+        uint64_t cacheKey = programCacheKey(vertexShaderSource.c_str(), fragmentShaderSource.c_str());
+        GLuint ShaderProgram = loadProgramBinary(cacheKey);
+        if (ShaderProgram)
+        {
+            printf("Loaded program binary for %s in %.2f ms\n", name.c_str(), (glfwGetTime() - start) * 1000.0);
+            setTextureUnits(ShaderProgram);
+            return ShaderProgram;
+        }
 
         // compile shaders
-        GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexShaderSource);
-        GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentShaderSource);
+        GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexShaderSource.c_str());
+        GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentShaderSource.c_str());
 
         // create shader program consisting of vertex and fragment shader
-        GLuint ShaderProgram = linkShaderProgram(vertexShader, fragmentShader);
+        ShaderProgram = linkShaderProgram(vertexShader, fragmentShader);
 
         // cleanup
         glDeleteShader(vertexShader);
         glDeleteShader(fragmentShader);
 
+        if (ShaderProgram)
+        {
+            printf("Compiled and linked %s in %.2f ms\n", name.c_str(), (glfwGetTime() - start) * 1000.0);
+            writeProgramBinary(cacheKey, ShaderProgram);
+            setTextureUnits(ShaderProgram);
+        }
+
         return ShaderProgram;
     }
 
-    vao createVertexArrayObject(std::vector<vertex> vertices)
+    // one set of defines applied to a pair of shader files
+    struct shaderPermutation
     {
-        // load vertex data
-        GLuint vertexCount = vertices.size();
+        std::string vertexPath;
+        std::string fragmentPath;
+        shaderDefines defines;
+        std::string name;
+        GLuint program;
+
+        // files that are watched for changes, and the callbacks that receive reloaded programs
+        std::vector<std::string> watchedFiles;
+        std::vector<std::function<void(GLuint)>> onLoaded;
+
+        // program of the running reload, 0 if there is none
+        GLuint pendingProgram;
+        GLuint pendingVertexShader;
+        GLuint pendingFragmentShader;
+        uint64_t pendingCacheKey;
+        double reloadStart;
+    };
 
-        // create vertex array object
-        GLuint vertexArrayObject;
-        glGenVertexArrays(1, &vertexArrayObject);
-        glBindVertexArray(vertexArrayObject);
+    // permutations by key, so every permutation compiles only once per process
+    static std::map<std::string, std::shared_ptr<shaderPermutation>> shaderPermutations;
+
+    static std::string shaderPermutationKey(const char* vertShaderSourceFile, const char* fragShaderSourceFile, shaderDefines defines)
+    {
+        std::sort(defines.begin(), defines.end());
+        std::string key = std::string(vertShaderSourceFile) + "|" + fragShaderSourceFile;
+        for (const std::string& define : defines)
+            key += "|" + define;
+        return key;
+    }
+
+    static bool preprocessShaderPermutation(const shaderPermutation& permutation, std::string& vertexShaderSource, std::string& fragmentShaderSource, std::vector<std::string>* files)
+    {
+        return preprocessShaderSource(permutation.vertexPath.c_str(), permutation.defines, vertexShaderSource, files) &&
+            preprocessShaderSource(permutation.fragmentPath.c_str(), permutation.defines, fragmentShaderSource, files);
+    }
+
+    static void deletePendingShaderProgram(shaderPermutation& permutation)
+    {
+        glDeleteProgram(permutation.pendingProgram);
+        glDeleteShader(permutation.pendingVertexShader);
+        glDeleteShader(permutation.pendingFragmentShader);
+        permutation.pendingProgram = 0;
+    }
+
+    static void watchShaderPermutation(std::shared_ptr<shaderPermutation> permutation, const std::vector<std::string>& files);
+
+    // polls the running reload once per frame and swaps the program before the frame is drawn.
+    // a program that fails to compile or link is dropped and the previous one stays in use
+    static void finishShaderProgramReload(std::shared_ptr<shaderPermutation> permutation)
+    {
+        shaderPermutation& state = *permutation;
+        if (!state.pendingProgram)
+            return;
+        if (!isProgramReady(state.pendingProgram))
+        {
+            queueUpload([permutation]() { finishShaderProgramReload(permutation); });
+            return;
+        }
+
+        bool compiled = checkShaderCompiled(state.pendingVertexShader);
+        compiled = checkShaderCompiled(state.pendingFragmentShader) && compiled;
+        if (!compiled || !checkShaderProgramLinked(state.pendingProgram))
+        {
+            std::cout << "Reloading " << state.name << " failed, keeping the previous program" << std::endl;
+            deletePendingShaderProgram(state);
+            return;
+        }
+
+        GLuint program = state.pendingProgram;
+        glDetachShader(program, state.pendingVertexShader);
+        glDetachShader(program, state.pendingFragmentShader);
+        glDeleteShader(state.pendingVertexShader);
+        glDeleteShader(state.pendingFragmentShader);
+        state.pendingProgram = 0;
+        setTextureUnits(program);
+        writeProgramBinary(state.pendingCacheKey, program);
+
+        releaseProgramReflection(state.program);
+        glDeleteProgram(state.program);
+        state.program = program;
+        printf("Reloaded %s after %.2f ms\n", state.name.c_str(), (glfwGetTime() - state.reloadStart) * 1000.0);
+        for (size_t i = 0; i < state.onLoaded.size(); ++i)
+            state.onLoaded[i](program);
+    }
+
+    static void beginShaderProgramReload(std::shared_ptr<shaderPermutation> permutation)
+    {
+        shaderPermutation& state = *permutation;
+        std::string vertexShaderSource, fragmentShaderSource;
+        std::vector<std::string> files;
+        if (!preprocessShaderPermutation(state, vertexShaderSource, fragmentShaderSource, &files))
+            return;
+        watchShaderPermutation(permutation, files);
+
+        // a newer change replaces a reload that is still running
+        bool running = state.pendingProgram != 0;
+        if (running)
+            deletePendingShaderProgram(state);
+
+        // compile and link without querying the results, so the driver can work in the background
+        state.reloadStart = glfwGetTime();
+        state.pendingCacheKey = programCacheKey(vertexShaderSource.c_str(), fragmentShaderSource.c_str());
+        state.pendingVertexShader = beginCompileShader(GL_VERTEX_SHADER, vertexShaderSource.c_str());
+        state.pendingFragmentShader = beginCompileShader(GL_FRAGMENT_SHADER, fragmentShaderSource.c_str());
+        state.pendingProgram = beginLinkShaderProgram(state.pendingVertexShader, state.pendingFragmentShader);
+        if (!running)
+            queueUpload([permutation]() { finishShaderProgramReload(permutation); });
+    }
+
+    // watches files the permutation is built from that are not watched yet, including new includes
+    static void watchShaderPermutation(std::shared_ptr<shaderPermutation> permutation, const std::vector<std::string>& files)
+    {
+        for (const std::string& file : files)
+        {
+            if (std::find(permutation->watchedFiles.begin(), permutation->watchedFiles.end(), file) != permutation->watchedFiles.end())
+                continue;
+            permutation->watchedFiles.push_back(file);
+            watchFile(file.c_str(), [permutation]() { beginShaderProgramReload(permutation); });
+        }
+    }
+
+    static std::shared_ptr<shaderPermutation> getShaderPermutation(const char* vertShaderSourceFile, const char* fragShaderSourceFile, const shaderDefines& defines, std::vector<std::string>* files)
+    {
+        std::string key = shaderPermutationKey(vertShaderSourceFile, fragShaderSourceFile, defines);
+        auto cached = shaderPermutations.find(key);
+        if (cached != shaderPermutations.end())
+        {
+            // only the list of files is needed from the sources
+            std::string vertexShaderSource, fragmentShaderSource;
+            if (files)
+                preprocessShaderPermutation(*cached->second, vertexShaderSource, fragmentShaderSource, files);
+            return cached->second;
+        }
+
+        std::shared_ptr<shaderPermutation> permutation = std::make_shared<shaderPermutation>();
+        permutation->vertexPath = vertShaderSourceFile;
+        permutation->fragmentPath = fragShaderSourceFile;
+        permutation->defines = defines;
+        permutation->name = std::string(vertShaderSourceFile) + " and " + fragShaderSourceFile;
+        for (const std::string& define : defines)
+            permutation->name += " " + define;
+
+        // load shader source code with includes and defines resolved
+        std::string vertexShaderSource, fragmentShaderSource;
+        bool preprocessed = preprocessShaderPermutation(*permutation, vertexShaderSource, fragmentShaderSource, files);
+        permutation->program = preprocessed ? buildShaderProgram(vertexShaderSource, fragmentShaderSource, permutation->name) : 0;
+        permutation->pendingProgram = 0;
+        shaderPermutations[key] = permutation;
+        return permutation;
+    }
+
+    // returns the program of the permutation, each permutation is compiled once per process
+    GLuint loadShaderProgram(const char* vertShaderSourceFile, const char* fragShaderSourceFile, const shaderDefines& defines = shaderDefines())
+    {
+        return getShaderPermutation(vertShaderSourceFile, fragShaderSourceFile, defines, NULL)->program;
+    }
+
+    // loads the program now and again whenever one of the source files or their includes changes,
+    // onLoaded receives every new program, the previous one is deleted after the call
+    void loadShaderProgramWatched(const char* vertShaderSourceFile, const char* fragShaderSourceFile, const shaderDefines& defines, std::function<void(GLuint)> onLoaded)
+    {
+        std::vector<std::string> files;
+        std::shared_ptr<shaderPermutation> permutation = getShaderPermutation(vertShaderSourceFile, fragShaderSourceFile, defines, &files);
+        permutation->onLoaded.push_back(onLoaded);
+        onLoaded(permutation->program);
+        watchShaderPermutation(permutation, files);
+    }
+
+    // links a vertex shader without rasterization whose outputs are captured interleaved in the order of varyings,
+    // instance attributes are bound to the same locations as in beginLinkShaderProgram
+    GLuint loadTransformFeedbackProgram(const char* vertShaderSourceFile, const char* const* varyings, GLsizei varyingCount)
+    {
+        std::string vertexShaderSource;
+        if (!preprocessShaderSource(vertShaderSourceFile, shaderDefines(), vertexShaderSource, NULL))
+            return 0;
+        GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexShaderSource.c_str());
+        if (!vertexShader)
+            return 0;
+
+        GLuint shaderProgramID = glCreateProgram();
+        glAttachShader(shaderProgramID, vertexShader);
+        glBindAttribLocation(shaderProgramID, 4, "instanceOffset");
+        glBindAttribLocation(shaderProgramID, 5, "instanceColor");
+        glTransformFeedbackVaryings(shaderProgramID, varyingCount, varyings, GL_INTERLEAVED_ATTRIBS);
+        glLinkProgram(shaderProgramID);
+        glDetachShader(shaderProgramID, vertexShader);
+        glDeleteShader(vertexShader);
+        if (!checkShaderProgramLinked(shaderProgramID))
+        {
+            glDeleteProgram(shaderProgramID);
+            return 0;
+        }
+        return shaderProgramID;
+    }
+
+    // byte offsets of position, texcoord, normal and color in a vertex of the layout, returns the vertex size
+    GLsizei getVertexOffsets(const vertexLayout& layout, GLsizei offsets[4])
+    {
+        offsets[0] = 0;
+        offsets[1] = offsets[0] + (layout.quantizedPositions ? 4 * sizeof(GLshort) : 3 * sizeof(GLfloat));
+        offsets[2] = offsets[1] + (layout.halfTexcoords ? 2 * sizeof(GLhalf) : 2 * sizeof(GLfloat));
+        offsets[3] = offsets[2] + (layout.packedNormals ? sizeof(GLuint) : 3 * sizeof(GLfloat));
+        return offsets[3] + (layout.byteColors ? 4 * sizeof(GLubyte) : 3 * sizeof(GLfloat));
+    }
+
+    GLsizei getVertexStride(const vertexLayout& layout)
+    {
+        GLsizei offsets[4];
+        return getVertexOffsets(layout, offsets);
+    }
+
+    bool isFloatVertexLayout(const vertexLayout& layout)
+    {
+        return !layout.quantizedPositions && !layout.halfTexcoords && !layout.packedNormals && !layout.byteColors;
+    }
+
+    // 10_10_10_2 vertex attributes need OpenGL 3.3, older contexts get the normals as four bytes of the same size
+    static bool supportsPackedNormals()
+    {
+        return GLAD_GL_VERSION_3_3 != 0;
+    }
 
-        // create vertex buffer object
-        GLuint vertexBufferObject;
-        glGenBuffers(1, &vertexBufferObject);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBufferObject);
-        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(vertex), vertices.data(), GL_STATIC_DRAW);
+    // the smallest cube around the positions, center in xyz and half size in w
+    glm::vec4 getPositionBounds(const vertex* vertices, GLuint vertexCount)
+    {
+        if (vertexCount == 0)
+            return glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        glm::vec3 lower = vertices[0].position, upper = vertices[0].position;
+        for (GLuint i = 1; i < vertexCount; ++i)
+        {
+            lower = glm::min(lower, vertices[i].position);
+            upper = glm::max(upper, vertices[i].position);
+        }
+        glm::vec3 extent = (upper - lower) * 0.5f;
+        float size = std::max(std::max(extent.x, extent.y), extent.z);
+        return glm::vec4((lower + upper) * 0.5f, size > 0.0f ? size : 1.0f);
+    }
+
+    // converts the vertices to the layout, quantized positions are stored relative to the cube of getPositionBounds
+    std::vector<unsigned char> packVertices(const vertex* vertices, GLuint vertexCount, const vertexLayout& layout, const glm::vec4& positionBounds)
+    {
+        GLsizei offsets[4];
+        GLsizei stride = getVertexOffsets(layout, offsets);
+        const bool packedNormals = supportsPackedNormals();
+        std::vector<unsigned char> packed((size_t)vertexCount * stride);
+        for (GLuint i = 0; i < vertexCount; ++i)
+        {
+            const vertex& source = vertices[i];
+            unsigned char* target = packed.data() + (size_t)i * stride;
+            if (layout.quantizedPositions)
+            {
+                glm::uint64 position = glm::packSnorm4x16(glm::vec4((source.position - glm::vec3(positionBounds)) / positionBounds.w, 0.0f));
+                memcpy(target + offsets[0], &position, sizeof(position));
+            }
+            else
+                memcpy(target + offsets[0], &source.position, sizeof(source.position));
+            if (layout.halfTexcoords)
+            {
+                glm::uint texcoord = glm::packHalf2x16(source.texcoord);
+                memcpy(target + offsets[1], &texcoord, sizeof(texcoord));
+            }
+            else
+                memcpy(target + offsets[1], &source.texcoord, sizeof(source.texcoord));
+            if (layout.packedNormals)
+            {
+                glm::vec4 normal(source.normal, 0.0f);
+                glm::uint packedNormal = packedNormals ? glm::packSnorm3x10_1x2(normal) : glm::packSnorm4x8(normal);
+                memcpy(target + offsets[2], &packedNormal, sizeof(packedNormal));
+            }
+            else
+                memcpy(target + offsets[2], &source.normal, sizeof(source.normal));
+            if (layout.byteColors)
+            {
+                glm::uint color = glm::packUnorm4x8(glm::vec4(source.color, 1.0f));
+                memcpy(target + offsets[3], &color, sizeof(color));
+            }
+            else
+                memcpy(target + offsets[3], &source.color, sizeof(source.color));
+        }
+        return packed;
+    }
 
-        // assign vertex attributes
+    // points attributes 0 to 3 at the vertex buffer bound to GL_ARRAY_BUFFER, the vertex array object has to be bound
+    void setVertexAttributes(const vertexLayout& layout)
+    {
+        GLsizei offsets[4];
+        GLsizei stride = getVertexOffsets(layout, offsets);
         glEnableVertexAttribArray(0);
         glEnableVertexAttribArray(1);
         glEnableVertexAttribArray(2);
         glEnableVertexAttribArray(3);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)offsetof(vertex, position));
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)offsetof(vertex, texcoord));
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)offsetof(vertex, normal));
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)offsetof(vertex, color));
+        if (layout.quantizedPositions)
+            glVertexAttribPointer(0, 4, GL_SHORT, GL_TRUE, stride, (void*)(size_t)offsets[0]);
+        else
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)(size_t)offsets[0]);
+        if (layout.halfTexcoords)
+            glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)(size_t)offsets[1]);
+        else
+            glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)(size_t)offsets[1]);
+        if (layout.packedNormals)
+            glVertexAttribPointer(2, 4, supportsPackedNormals() ? GL_INT_2_10_10_10_REV : GL_BYTE, GL_TRUE, stride, (void*)(size_t)offsets[2]);
+        else
+            glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(size_t)offsets[2]);
+        if (layout.byteColors)
+            glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)(size_t)offsets[3]);
+        else
+            glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride, (void*)(size_t)offsets[3]);
+    }
+
+    // fills the vertex buffer bound to GL_ARRAY_BUFFER in the layout and points the attributes of the bound
+    // vertex array object at it, vertices may be NULL to only allocate storage for the float layout
+    static void uploadVertices(vao& vertexArrayObject, const vertex* vertices, GLuint vertexCount, const vertexLayout& layout)
+    {
+        glm::vec4 bounds(0.0f, 0.0f, 0.0f, 1.0f);
+        if (isFloatVertexLayout(layout) || !vertices)
+            glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)vertexCount * getVertexStride(layout), vertices, GL_STATIC_DRAW);
+        else
+        {
+            if (layout.quantizedPositions)
+                bounds = getPositionBounds(vertices, vertexCount);
+            std::vector<unsigned char> packed = packVertices(vertices, vertexCount, layout, bounds);
+            glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
+        }
+        setVertexAttributes(layout);
+        vertexArrayObject.vertexCount = vertexCount;
+        vertexArrayObject.layout = layout;
+        memcpy(vertexArrayObject.positionBounds, glm::value_ptr(bounds), sizeof(vertexArrayObject.positionBounds));
+    }
+
+    // model matrix that turns the stored positions back into the positions of the vertices
+    glm::mat4 getPositionTransform(const vao& vertexArrayObject)
+    {
+        if (!vertexArrayObject.layout.quantizedPositions)
+            return glm::mat4(1.0f);
+        glm::vec4 bounds = glm::make_vec4(vertexArrayObject.positionBounds);
+        return glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(bounds)), glm::vec3(bounds.w));
+    }
+
+    vao createVertexArrayObject(const vertex* vertices, GLuint vertexCount, const vertexLayout& layout = floatVertexLayout)
+    {
+        vao result{};
+
+        // create vertex array object
+        glGenVertexArrays(1, &result.id);
+        glBindVertexArray(result.id);
+
+        // create vertex buffer object and assign vertex attributes
+        glGenBuffers(1, &result.vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, result.vbo);
+        uploadVertices(result, vertices, vertexCount, layout);
+
+        // cleanup
+        glBindVertexArray(0);
+
+        return result;
+    }
+
+    vao createVertexArrayObject(std::vector<vertex> vertices)
+    {
+        // load vertex data
+        return createVertexArrayObject(vertices.data(), vertices.size());
+    }
+
+    vao createVertexArrayObject(const vertex* vertices, GLuint vertexCount, const void* indices, GLuint indexCount, GLenum indexType, const vertexLayout& layout = floatVertexLayout)
+    {
+        vao result = createVertexArrayObject(vertices, vertexCount, layout);
+        result.indexCount = indexCount;
+        result.indexType = indexType;
+
+        // create element buffer object, the binding is stored in the vertex array object
+        GLsizeiptr indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+        glBindVertexArray(result.id);
+        glGenBuffers(1, &result.ebo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, result.ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * indexSize, indices, GL_STATIC_DRAW);
+
+        // cleanup
+        glBindVertexArray(0);
+
+        return result;
+    }
+
+    vao createVertexArrayObject(const std::vector<vertex>& vertices, const std::vector<GLuint>& indices, const vertexLayout& layout = floatVertexLayout)
+    {
+        if (vertices.size() <= 65536)
+        {
+            // small meshes only need half the index memory
+            std::vector<GLushort> shortIndices(indices.begin(), indices.end());
+            return createVertexArrayObject(vertices.data(), vertices.size(), shortIndices.data(), shortIndices.size(), GL_UNSIGNED_SHORT, layout);
+        }
+        return createVertexArrayObject(vertices.data(), vertices.size(), indices.data(), indices.size(), GL_UNSIGNED_INT, layout);
+    }
+
+    static_assert(sizeof(vertex) == vertexComponentCount * sizeof(float), "vertex streams convert vertices as 11 floats");
+
+    // converts the vertices to one array per component
+    bool toVertexStreams(const vertex* vertices, GLuint vertexCount, vertexStreams& streams)
+    {
+        if (!vertexStreamsAllocate(streams, vertexCount))
+            return false;
+        vertexStreamsFromInterleaved((const float*)vertices, vertexCount, streams);
+        return true;
+    }
+
+    std::vector<vertex> fromVertexStreams(const vertexStreams& streams)
+    {
+        std::vector<vertex> vertices(streams.count);
+        vertexStreamsToInterleaved(streams, (float*)vertices.data());
+        return vertices;
+    }
+
+    // each attribute occupies its own range of the vertex buffer, starting after the components of the previous ones
+    static GLintptr getVertexStreamOffset(GLuint vertexCount, vertexStream stream)
+    {
+        return (GLintptr)vertexCount * vertexStreamFirstComponent(stream) * sizeof(float);
+    }
+
+    // uploads every attribute to its own range of the vertex buffer without interleaving them,
+    // so updateVertexStream can replace one attribute while the others stay in place
+    vao createVertexArrayObject(const vertexStreams& streams)
+    {
+        vao result = createVertexArrayObject(NULL, streams.count);
+        glBindVertexArray(result.id);
+        glBindBuffer(GL_ARRAY_BUFFER, result.vbo);
+        std::vector<float> values(streams.count * 3);
+        for (int stream = 0; stream < vertexStreamCount; ++stream)
+        {
+            GLint size = vertexStreamComponentCount((vertexStream)stream);
+            GLintptr offset = getVertexStreamOffset(streams.count, (vertexStream)stream);
+            vertexStreamsToStream(streams, (vertexStream)stream, values.data());
+            glBufferSubData(GL_ARRAY_BUFFER, offset, streams.count * size * sizeof(float), values.data());
+            glVertexAttribPointer(stream, size, GL_FLOAT, GL_FALSE, 0, (void*)offset);
+        }
+        glBindVertexArray(0);
+        return result;
+    }
+
+    // replaces one attribute of a vertex array object created from vertex streams with the same vertex count
+    void updateVertexStream(const vao& vertexArrayObject, const vertexStreams& streams, vertexStream stream)
+    {
+        GLint size = vertexStreamComponentCount(stream);
+        std::vector<float> values(streams.count * size);
+        vertexStreamsToStream(streams, stream, values.data());
+        glBindBuffer(GL_ARRAY_BUFFER, vertexArrayObject.vbo);
+        glBufferSubData(GL_ARRAY_BUFFER, getVertexStreamOffset(streams.count, stream), values.size() * sizeof(float), values.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // draws the vertices once per instance, requires glVertexAttribDivisor (OpenGL 3.3 or ARB_instanced_arrays)
+    vao createInstancedVertexArrayObject(const vertex* vertices, GLuint vertexCount, const instance* instances, GLuint instanceCount)
+    {
+        if (!glVertexAttribDivisor)
+        {
+            std::cerr << "Instanced drawing requires glVertexAttribDivisor" << std::endl;
+            return {};
+        }
+
+        vao result = createVertexArrayObject(vertices, vertexCount);
+        result.instanceCount = instanceCount;
+
+        // instance attributes advance once per instance instead of once per vertex
+        glBindVertexArray(result.id);
+        glGenBuffers(1, &result.instanceBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, result.instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, instanceCount * sizeof(instance), instances, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(4);
+        glEnableVertexAttribArray(5);
+        glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(instance), (void*)offsetof(instance, offset));
+        glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(instance), (void*)offsetof(instance, color));
+        glVertexAttribDivisor(4, 1);
+        glVertexAttribDivisor(5, 1);
 
         // cleanup
         glBindVertexArray(0);
 
-        return { vertexArrayObject, vertexBufferObject, vertexCount };
+        return result;
+    }
+
+    // replaces the instances without creating a new vertex array object, a different count orphans the old storage
+    // so draws still reading it don't have to finish first
+    void updateInstances(vao& vertexArrayObject, const instance* instances, GLuint instanceCount)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, vertexArrayObject.instanceBuffer);
+        if (instanceCount != vertexArrayObject.instanceCount)
+            glBufferData(GL_ARRAY_BUFFER, instanceCount * sizeof(instance), NULL, GL_STATIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, instanceCount * sizeof(instance), instances);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        vertexArrayObject.instanceCount = instanceCount;
+    }
+
+    // replaces the vertices and indices of the vertex array object in new buffer storage, or creates it on the first call.
+    // the layout may differ from the previous one
+    void updateVertexArrayObject(vao& vertexArrayObject, const std::vector<vertex>& vertices, const std::vector<GLuint>& indices, const vertexLayout& layout = floatVertexLayout)
+    {
+        if (!vertexArrayObject.id)
+        {
+            vertexArrayObject = indices.empty() ? createVertexArrayObject(vertices.data(), vertices.size(), layout) : createVertexArrayObject(vertices, indices, layout);
+            return;
+        }
+
+        glBindVertexArray(vertexArrayObject.id);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexArrayObject.vbo);
+        uploadVertices(vertexArrayObject, vertices.data(), vertices.size(), layout);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        if (!vertexArrayObject.ebo)
+        {
+            glBindVertexArray(0);
+            return;
+        }
+
+        // small meshes only need half the index memory
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vertexArrayObject.ebo);
+        if (vertices.size() <= 65536)
+        {
+            std::vector<GLushort> shortIndices(indices.begin(), indices.end());
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(GLushort), shortIndices.data(), GL_STATIC_DRAW);
+            vertexArrayObject.indexType = GL_UNSIGNED_SHORT;
+        }
+        else
+        {
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+            vertexArrayObject.indexType = GL_UNSIGNED_INT;
+        }
+        glBindVertexArray(0);
+        vertexArrayObject.indexCount = indices.size();
+    }
+
+    // Loads an OBJ file as indexed mesh. The first load writes a binary cache next
+    // to the file, later loads map that cache and upload it without any parsing.
+    vao loadMeshVertexArrayObject(const char* path)
+    {
+        cachedMesh cached;
+        if (!loadMeshCache(path, cached))
+        {
+            mesh loaded = loadOBJMesh(path);
+            if (loaded.vertices.empty())
+                return {};
+            writeMeshCache(path, loaded);
+            return createVertexArrayObject(loaded.vertices, loaded.indices);
+        }
+
+        vao result = createVertexArrayObject(cached.vertices, cached.vertexCount, cached.indices, cached.indexCount, cached.indexType);
+        releaseMeshCache(cached);
+        return result;
+    }
+
+    // builds the vertices on a worker thread and creates the vertex array object during a later frame
+    void createVertexArrayObjectAsync(std::function<std::vector<vertex>()> createVertices, std::function<void(vao)> onCreated)
+    {
+        queueJob([createVertices, onCreated]() {
+            std::shared_ptr<std::vector<vertex>> vertices = std::make_shared<std::vector<vertex>>(createVertices());
+            queueUpload([vertices, onCreated]() {
+                onCreated(createVertexArrayObject(vertices->data(), vertices->size()));
+            });
+        });
+    }
+
+    void drawVertexArrayObject(const vao& vertexArrayObject)
+    {
+        glBindVertexArray(vertexArrayObject.id);
+        if (vertexArrayObject.ebo)
+            glDrawElements(GL_TRIANGLES, vertexArrayObject.indexCount, vertexArrayObject.indexType, 0);
+        else if (vertexArrayObject.instanceBuffer)
+            glDrawArraysInstanced(GL_TRIANGLES, 0, vertexArrayObject.vertexCount, vertexArrayObject.instanceCount);
+        else
+            glDrawArrays(GL_TRIANGLES, 0, vertexArrayObject.vertexCount);
     }
 }
 
@@ -156,63 +781,322 @@ glm::vec3 calculateNormal(const glm::vec3 a, const glm::vec3 b, const glm::vec3
     return glm::normalize(n);
 }
 
-std::vector<vertex> createCubeVertices()
+// primitives that can be packed into one vertex array object, their vertices are emitted indexed
+enum primitiveType
+{
+    primitiveCube,
+    primitiveSphere,
+    primitiveTorus,
+    primitivePlane,
+    primitiveCylinder,
+    primitiveTypeCount
+};
+
+static const char* primitiveNames[primitiveTypeCount] = { "Cube", "Sphere", "Torus", "Plane", "Cylinder" };
+
+struct primitiveSize
+{
+    GLuint vertexCount;
+    GLuint indexCount;
+};
+
+// detail is the number of segments along the shortest curve of the primitive, the cube ignores it
+primitiveSize getPrimitiveSize(primitiveType type, int detail)
+{
+    GLuint n = (GLuint)std::max(detail, 3);
+    switch (type)
+    {
+    case primitiveCube:
+        return { 24, 36 };
+    case primitiveSphere:
+    case primitiveTorus:
+        return { (2 * n + 1) * (n + 1), 2 * n * n * 6 };
+    case primitivePlane:
+        return { (n + 1) * (n + 1), n * n * 6 };
+    case primitiveCylinder:
+        // side with a seam column plus a triangle fan for each cap
+        return { (2 * n + 1) * 2 + 2 * (2 * n + 1), 2 * n * 6 + 2 * 2 * n * 3 };
+    default:
+        return { 0, 0 };
+    }
+}
+
+// writes the indices of a grid with (columns + 1) x (rows + 1) vertices in row major order, the
+// triangles are counter clockwise when the column direction crossed with the row direction points out
+template <typename index>
+static index* writeGridIndices(int columns, int rows, GLuint first, index* indices)
+{
+    for (int row = 0; row < rows; ++row)
+    {
+        for (int column = 0; column < columns; ++column)
+        {
+            GLuint a = first + row * (columns + 1) + column;
+            GLuint c = a + columns + 1;
+            indices[0] = (index)a;
+            indices[1] = (index)(a + 1);
+            indices[2] = (index)(c + 1);
+            indices[3] = (index)a;
+            indices[4] = (index)(c + 1);
+            indices[5] = (index)c;
+            indices += 6;
+        }
+    }
+    return indices;
+}
+
+// the cube keeps a separate color per face, the other primitives color by normal
+static glm::vec3 normalColor(glm::vec3 normal)
+{
+    return normal * 0.5f + 0.5f;
+}
+
+static void writeCubeVertices(vertex* vertices)
+{
+    // normal, the two directions spanning the face with right x up == normal, and the face color
+    static const float faces[6][12] = {
+        {  0, 0, 1,    1, 0, 0,    0, 1, 0,    1, 0, 0 },
+        {  0, 0,-1,   -1, 0, 0,    0, 1, 0,    0, 1, 1 },
+        {  0,-1, 0,    1, 0, 0,    0, 0, 1,    0, 1, 0 },
+        {  0, 1, 0,    0, 0, 1,    1, 0, 0,    1, 0, 1 },
+        {  1, 0, 0,    0, 1, 0,    0, 0, 1,    0, 0, 1 },
+        { -1, 0, 0,    0, 0, 1,    0, 1, 0,    1, 1, 0 },
+    };
+    for (int face = 0; face < 6; ++face)
+    {
+        glm::vec3 normal = glm::make_vec3(faces[face]);
+        glm::vec3 right = glm::make_vec3(faces[face] + 3);
+        glm::vec3 up = glm::make_vec3(faces[face] + 6);
+        glm::vec3 color = glm::make_vec3(faces[face] + 9);
+        for (int corner = 0; corner < 4; ++corner)
+        {
+            // corners in counter clockwise order
+            glm::vec2 texcoord((corner == 1 || corner == 2) ? 1.0f : 0.0f, corner >= 2 ? 1.0f : 0.0f);
+            glm::vec3 position = normal + right * (texcoord.x * 2.0f - 1.0f) + up * (texcoord.y * 2.0f - 1.0f);
+            *vertices++ = vertex{ position, texcoord, normal, color };
+        }
+    }
+}
+
+template <typename index>
+static void writeCubeIndices(index* indices)
+{
+    for (GLuint face = 0; face < 6; ++face)
+    {
+        GLuint a = face * 4;
+        index quad[6] = { (index)a, (index)(a + 1), (index)(a + 2), (index)a, (index)(a + 2), (index)(a + 3) };
+        std::copy(quad, quad + 6, indices + face * 6);
+    }
+}
+
+// unit sphere, longitude runs along the columns and latitude from the south pole along the rows
+static void writeSphereVertices(int slices, int stacks, vertex* vertices)
+{
+    const float pi = glm::pi<float>();
+    for (int stack = 0; stack <= stacks; ++stack)
+    {
+        float v = (float)stack / stacks;
+        float latitude = (v - 0.5f) * pi;
+        for (int slice = 0; slice <= slices; ++slice)
+        {
+            float u = (float)slice / slices;
+            float longitude = u * 2.0f * pi;
+            glm::vec3 normal(std::cos(latitude) * std::sin(longitude), std::sin(latitude), std::cos(latitude) * std::cos(longitude));
+            *vertices++ = vertex{ normal, glm::vec2(u, v), normal, normalColor(normal) };
+        }
+    }
+}
+
+// torus around the y axis, the tube angle runs along the rows
+static void writeTorusVertices(float majorRadius, float minorRadius, int slices, int rings, vertex* vertices)
+{
+    const float pi = glm::pi<float>();
+    for (int ring = 0; ring <= rings; ++ring)
+    {
+        float v = (float)ring / rings;
+        float tube = v * 2.0f * pi;
+        for (int slice = 0; slice <= slices; ++slice)
+        {
+            float u = (float)slice / slices;
+            float angle = u * 2.0f * pi;
+            glm::vec3 center(majorRadius * std::sin(angle), 0.0f, majorRadius * std::cos(angle));
+            glm::vec3 normal(std::cos(tube) * std::sin(angle), std::sin(tube), std::cos(tube) * std::cos(angle));
+            *vertices++ = vertex{ center + normal * minorRadius, glm::vec2(u, v), normal, normalColor(normal) };
+        }
+    }
+}
+
+// square in the xz plane facing up
+static void writePlaneVertices(int divisions, vertex* vertices)
+{
+    const glm::vec3 normal(0, 1, 0);
+    for (int row = 0; row <= divisions; ++row)
+    {
+        float v = (float)row / divisions;
+        for (int column = 0; column <= divisions; ++column)
+        {
+            float u = (float)column / divisions;
+            *vertices++ = vertex{ glm::vec3(u * 2.0f - 1.0f, 0.0f, 1.0f - v * 2.0f), glm::vec2(u, v), normal, normalColor(normal) };
+        }
+    }
+}
+
+// cylinder along the y axis, the side comes first and is followed by the top and the bottom cap
+template <typename index>
+static void writeCylinder(int slices, vertex* vertices, index* indices)
+{
+    const float pi = glm::pi<float>();
+    for (int row = 0; row <= 1; ++row)
+    {
+        for (int slice = 0; slice <= slices; ++slice)
+        {
+            float u = (float)slice / slices;
+            glm::vec3 normal(std::sin(u * 2.0f * pi), 0.0f, std::cos(u * 2.0f * pi));
+            *vertices++ = vertex{ normal + glm::vec3(0.0f, row * 2.0f - 1.0f, 0.0f), glm::vec2(u, (float)row), normal, normalColor(normal) };
+        }
+    }
+    indices = writeGridIndices(slices, 1, 0, indices);
+
+    GLuint first = (slices + 1) * 2;
+    for (int cap = 0; cap < 2; ++cap)
+    {
+        // the center is followed by the rim, the bottom fan turns the other way to face down
+        glm::vec3 normal(0.0f, cap == 0 ? 1.0f : -1.0f, 0.0f);
+        *vertices++ = vertex{ normal, glm::vec2(0.5f), normal, normalColor(normal) };
+        for (int slice = 0; slice < slices; ++slice)
+        {
+            float angle = (float)slice / slices * 2.0f * pi;
+            glm::vec2 rim(std::sin(angle), std::cos(angle));
+            *vertices++ = vertex{ glm::vec3(rim.x, normal.y, rim.y), rim * 0.5f + 0.5f, normal, normalColor(normal) };
+
+            GLuint current = first + 1 + slice, next = first + 1 + (slice + 1) % slices;
+            indices[0] = (index)first;
+            indices[1] = (index)(cap == 0 ? current : next);
+            indices[2] = (index)(cap == 0 ? next : current);
+            indices += 3;
+        }
+        first += slices + 1;
+    }
+}
+
+// writes exactly getPrimitiveSize(type, detail) vertices and indices, the indices start at 0
+template <typename index>
+void writePrimitive(primitiveType type, int detail, vertex* vertices, index* indices)
+{
+    int n = std::max(detail, 3);
+    switch (type)
+    {
+    case primitiveCube:
+        writeCubeVertices(vertices);
+        writeCubeIndices(indices);
+        break;
+    case primitiveSphere:
+        writeSphereVertices(2 * n, n, vertices);
+        writeGridIndices(2 * n, n, 0, indices);
+        break;
+    case primitiveTorus:
+        writeTorusVertices(0.7f, 0.3f, 2 * n, n, vertices);
+        writeGridIndices(2 * n, n, 0, indices);
+        break;
+    case primitivePlane:
+        writePlaneVertices(n, vertices);
+        writeGridIndices(n, n, 0, indices);
+        break;
+    case primitiveCylinder:
+        writeCylinder(2 * n, vertices, indices);
+        break;
+    default:
+        break;
+    }
+}
+
+// location of one primitive inside the shared buffers, drawn with glDrawElementsBaseVertex
+struct primitiveRange
+{
+    GLint baseVertex;
+    GLuint firstIndex;
+    GLuint indexCount;
+};
+
+// several primitives packed into one vertex and element buffer
+struct primitiveBuffer
+{
+    glframework::vao vertexArray;
+    std::vector<primitiveRange> ranges; // in the order the primitives were packed
+};
+
+// vertices and indices of a primitive buffer before the upload
+struct primitiveBufferData
 {
     std::vector<vertex> vertices;
-    
-    // TODO: create a cube here instead of a triangle and apply colors and correct normals
-    
-   
-    // Front Face
-    vertices.push_back(vertex{ glm::vec3(-1,-1, 1), glm::vec2(), glm::vec3(0, 0, 1), glm::vec3(1, 0, 0) }); //position, texture uv, normal, color 
-    vertices.push_back(vertex{ glm::vec3(1,-1, 1), glm::vec2(), glm::vec3(0, 0, 1), glm::vec3(1, 0, 0) });
-    vertices.push_back(vertex{ glm::vec3(-1,1, 1), glm::vec2(), glm::vec3(0, 0, 1), glm::vec3(1, 0, 0) });
-    vertices.push_back(vertex{ glm::vec3(1,-1, 1), glm::vec2(), glm::vec3(0, 0, 1), glm::vec3(1, 0, 0) });
-    vertices.push_back(vertex{ glm::vec3(1,1, 1), glm::vec2(), glm::vec3(0, 0, 1), glm::vec3(1, 0, 0) });
-    vertices.push_back(vertex{ glm::vec3(-1,1, 1), glm::vec2(), glm::vec3(0, 0, 1), glm::vec3(1, 0, 0) });
-
-    //Back Face
-    vertices.push_back(vertex{ glm::vec3(-1,-1, -1), glm::vec2(), glm::vec3(0, 0, -1), glm::vec3(0, 1, 1) });
-    vertices.push_back(vertex{ glm::vec3(-1,1, -1), glm::vec2(), glm::vec3(0, 0, -1), glm::vec3(0, 1, 1) });
-    vertices.push_back(vertex{ glm::vec3(1,-1, -1), glm::vec2(), glm::vec3(0, 0, -1), glm::vec3(0, 1, 1) });
-    vertices.push_back(vertex{ glm::vec3(1,-1, -1), glm::vec2(), glm::vec3(0, 0, -1), glm::vec3(0, 1, 1) });
-    vertices.push_back(vertex{ glm::vec3(-1,1, -1), glm::vec2(), glm::vec3(0, 0, -1), glm::vec3(0, 1, 1) });
-    vertices.push_back(vertex{ glm::vec3(1,1, -1), glm::vec2(), glm::vec3(0, 0, -1), glm::vec3(0, 1, 1) });
-
-    vertices.push_back(vertex{ glm::vec3(-1, -1,-1), glm::vec2(), glm::vec3(0, -1, 0), glm::vec3(0, 1, 0) });
-    vertices.push_back(vertex{ glm::vec3(1, -1,-1), glm::vec2(), glm::vec3(0, -1, 0), glm::vec3(0, 1, 0) });
-    vertices.push_back(vertex{ glm::vec3(-1, -1,1), glm::vec2(), glm::vec3(0, -1, 0), glm::vec3(0, 1, 0) });
-    vertices.push_back(vertex{ glm::vec3(1, -1,-1), glm::vec2(), glm::vec3(0, -1, 0), glm::vec3(0, 1, 0) });
-    vertices.push_back(vertex{ glm::vec3(1, -1,1), glm::vec2(), glm::vec3(0, -1, 0), glm::vec3(0, 1, 0) });
-    vertices.push_back(vertex{ glm::vec3(-1, -1,1), glm::vec2(), glm::vec3(0, -1, 0), glm::vec3(0, 1, 0) });
-
-    vertices.push_back(vertex{ glm::vec3(-1,1, -1), glm::vec2(), glm::vec3(0, 1, 0), glm::vec3(1, 0, 1) });
-    vertices.push_back(vertex{ glm::vec3(-1, 1,1), glm::vec2(), glm::vec3(0, 1, 0), glm::vec3(1, 0, 1) });
-    vertices.push_back(vertex{ glm::vec3(1, 1,-1), glm::vec2(), glm::vec3(0, 1, 0), glm::vec3(1, 0, 1) });
-    vertices.push_back(vertex{ glm::vec3(1, 1,-1), glm::vec2(), glm::vec3(0, 1, 0), glm::vec3(1, 0, 1) });
-    vertices.push_back(vertex{ glm::vec3(-1, 1,1), glm::vec2(), glm::vec3(0, 1, 0), glm::vec3(1, 0, 1) });
-    vertices.push_back(vertex{ glm::vec3(1, 1,1), glm::vec2(), glm::vec3(0, 1, 0), glm::vec3(1, 0, 1) });
-
-
-
-    vertices.push_back(vertex{ glm::vec3(1, -1,-1), glm::vec2(), glm::vec3(1, 0, 0), glm::vec3(0, 0, 1) });
-    vertices.push_back(vertex{ glm::vec3(1, 1,-1), glm::vec2(), glm::vec3(1, 0, 0), glm::vec3(0, 0, 1) });
-    vertices.push_back(vertex{ glm::vec3(1, -1,1), glm::vec2(), glm::vec3(1, 0, 0), glm::vec3(0, 0, 1) });
-    vertices.push_back(vertex{ glm::vec3(1, 1,-1), glm::vec2(), glm::vec3(1, 0, 0), glm::vec3(0, 0, 1) });
-    vertices.push_back(vertex{ glm::vec3(1, 1,1), glm::vec2(), glm::vec3(1, 0, 0), glm::vec3(0, 0, 1) });
-    vertices.push_back(vertex{ glm::vec3(1, -1,1), glm::vec2(), glm::vec3(1, 0, 0), glm::vec3(0, 0, 1) });
-
-    vertices.push_back(vertex{ glm::vec3(-1,-1, -1), glm::vec2(), glm::vec3(-1, 0, 0), glm::vec3(1, 1, 0) });
-    vertices.push_back(vertex{ glm::vec3(-1, -1,1), glm::vec2(), glm::vec3(-1, 0, 0), glm::vec3(1, 1, 0) });
-    vertices.push_back(vertex{ glm::vec3(-1, 1,-1), glm::vec2(), glm::vec3(-1, 0, 0), glm::vec3(1, 1, 0) });
-    vertices.push_back(vertex{ glm::vec3(-1, 1,-1), glm::vec2(), glm::vec3(-1, 0, 0), glm::vec3(1, 1, 0) });
-    vertices.push_back(vertex{ glm::vec3(-1, -1,1), glm::vec2(), glm::vec3(-1, 0, 0), glm::vec3(1, 1, 0) });
-    vertices.push_back(vertex{ glm::vec3(-1, 1,1), glm::vec2(), glm::vec3(-1, 0, 0), glm::vec3(1, 1, 0) });
+    std::vector<unsigned char> indices;
+    GLenum indexType;
+    std::vector<primitiveRange> ranges;
+};
+
+template <typename index>
+static void writePrimitives(const std::vector<primitiveType>& types, int detail, primitiveBufferData& data)
+{
+    index* indices = (index*)data.indices.data();
+    for (size_t i = 0; i < types.size(); ++i)
+        writePrimitive(types[i], detail, &data.vertices[data.ranges[i].baseVertex], indices + data.ranges[i].firstIndex);
+}
 
+// sizes all primitives first, so the vertices and indices are written straight into their final place
+primitiveBufferData buildPrimitiveBuffer(const std::vector<primitiveType>& types, int detail)
+{
+    primitiveBufferData data;
+    GLuint vertexCount = 0, indexCount = 0, largestPrimitive = 0;
+    for (primitiveType type : types)
+    {
+        primitiveSize size = getPrimitiveSize(type, detail);
+        data.ranges.push_back({ (GLint)vertexCount, indexCount, size.indexCount });
+        vertexCount += size.vertexCount;
+        indexCount += size.indexCount;
+        largestPrimitive = std::max(largestPrimitive, size.vertexCount);
+    }
 
+    // indices are relative to the base vertex, so short indices only need each primitive to be small
+    data.indexType = largestPrimitive <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    data.vertices.resize(vertexCount);
+    if (data.indexType == GL_UNSIGNED_SHORT)
+    {
+        data.indices.resize(indexCount * sizeof(GLushort));
+        writePrimitives<GLushort>(types, detail, data);
+    }
+    else
+    {
+        data.indices.resize(indexCount * sizeof(GLuint));
+        writePrimitives<GLuint>(types, detail, data);
+    }
+    return data;
+}
 
-    
-    return vertices;
+primitiveBuffer createPrimitiveBuffer(const primitiveBufferData& data)
+{
+    GLuint indexCount = (GLuint)(data.indices.size() / (data.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint)));
+    primitiveBuffer buffer;
+    buffer.vertexArray = glframework::createVertexArrayObject(data.vertices.data(), data.vertices.size(), data.indices.data(), indexCount, data.indexType, glframework::compactVertexLayout);
+    buffer.ranges = data.ranges;
+    return buffer;
+}
+
+// builds the primitives on a worker thread and uploads them during a later frame
+void createPrimitiveBufferAsync(const std::vector<primitiveType>& types, int detail, std::function<void(primitiveBuffer)> onCreated)
+{
+    glframework::queueJob([types, detail, onCreated]() {
+        std::shared_ptr<primitiveBufferData> data = std::make_shared<primitiveBufferData>(buildPrimitiveBuffer(types, detail));
+        glframework::queueUpload([data, onCreated]() {
+            onCreated(createPrimitiveBuffer(*data));
+        });
+    });
+}
+
+// draws one primitive of the buffer, the vertex array object of the buffer has to be bound
+void drawPrimitive(const primitiveBuffer& buffer, size_t primitive)
+{
+    const primitiveRange& range = buffer.ranges[primitive];
+    size_t indexSize = buffer.vertexArray.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, buffer.vertexArray.indexType, (void*)(range.firstIndex * indexSize), range.baseVertex);
 }
 
 using tetrahedron = std::array<vertex, 4>;
@@ -228,34 +1112,67 @@ vertex vertexLerp(vertex a, vertex b, float t)
     return c;
 }
 
-std::vector<tetrahedron> splitFractalTetrahedron(std::vector<tetrahedron> tetrahedra, int depth = 0)
+// number of tetrahedra after splitting one tetrahedron depth times
+size_t fractalTetrahedronCount(int depth)
 {
-    std::vector<tetrahedron> result;
+    return (size_t)1 << (2 * depth);
+}
+
+// splits the tetrahedron depth times into 4 smaller ones each, in place inside a single allocation of the final size
+std::vector<tetrahedron> splitFractalTetrahedron(const tetrahedron& initialTetrahedron, int depth)
+{
+    std::vector<tetrahedron> tetrahedra(fractalTetrahedronCount(depth));
+    tetrahedra[0] = initialTetrahedron;
 
-    for (const auto& th : tetrahedra)
+    for (size_t count = 1; count < tetrahedra.size(); count *= 4)
     {
-        std::array<tetrahedron, 4> splitTetrahedra{};
+        // tetrahedron i is replaced by 4i to 4i + 3, going backwards never overwrites an unsplit one
+        for (size_t i = count; i-- > 0;)
+        {
+            const tetrahedron th = tetrahedra[i];
 
-        // TODO: Subdivide tetrahedron to create 4 new ones.
-        // splitTetrahedra[0][0] = ;
-        // Each vertex is connected to each other vertex. The subdivision is done by computing the midpoint between all indices:
-        for (int i = 0; i < 4; ++i){
+            // Each vertex is connected to each other vertex. The subdivision is done by computing the midpoint between all indices:
             for (int j = 0; j < 4; ++j){
-                splitTetrahedra[i][j] = vertexLerp(th[i], th[j], 0.5f);
+                for (int k = 0; k < 4; ++k){
+                    tetrahedra[4 * i + j][k] = vertexLerp(th[j], th[k], 0.5f);
+                }
             }
         }
+    }
 
+    return tetrahedra;
+}
 
-        result.insert(result.end(), splitTetrahedra.cbegin(), splitTetrahedra.cend());
-    }
+// corners of the four triangles of a tetrahedron, counter clockwise seen from outside
+static const int fractalTetrahedronFaces[4][3] = { { 0, 1, 2 }, { 0, 2, 3 }, { 0, 3, 1 }, { 1, 3, 2 } };
 
-    if (depth < 5)
-        return splitFractalTetrahedron(result, depth + 1);
+// writes the faces of all tetrahedra that splitting th depth times creates, in the order of splitFractalTetrahedron
+static void writeFractalTetrahedronFaces(const tetrahedron& th, int depth, const glm::vec3* normals, vertex*& out)
+{
+    if (depth == 0)
+    {
+        for (int face = 0; face < 4; ++face)
+        {
+            for (int corner = 0; corner < 3; ++corner)
+            {
+                *out = th[fractalTetrahedronFaces[face][corner]];
+                out->normal = normals[face];
+                ++out;
+            }
+        }
+        return;
+    }
 
-    return result;
+    for (int j = 0; j < 4; ++j)
+    {
+        tetrahedron split;
+        for (int k = 0; k < 4; ++k)
+            split[k] = vertexLerp(th[j], th[k], 0.5f);
+        writeFractalTetrahedronFaces(split, depth - 1, normals, out);
+    }
 }
 
-std::vector<vertex> createFractalTetrahedronVertices()
+tetrahedron createInitialTetrahedron()
 {
     tetrahedron initialTetrahedron{};
     
@@ -272,65 +1189,416 @@ std::vector<vertex> createFractalTetrahedronVertices()
 
     // ...
 
-    std::vector<tetrahedron> FractalTetrahedra = splitFractalTetrahedron(std::vector<tetrahedron>{ initialTetrahedron });
+    return initialTetrahedron;
+}
 
-    std::vector<vertex> vertices;
-    // add all the tetrahedron faces to the vertex list as triangles
-    for (const auto& tetrahedron : FractalTetrahedra)
-    {
-        // TODO: calculate correct normals.
-        glm::vec3 normal = glm::vec3();
-        vertices.push_back(tetrahedron[0]);
-        vertices.back().normal = normal;
-        vertices.push_back(tetrahedron[1]);
-        vertices.back().normal = normal;
-        vertices.push_back(tetrahedron[2]);
-        vertices.back().normal = normal;
-
-        normal = glm::vec3();
-        vertices.push_back(tetrahedron[0]);
-        vertices.back().normal = normal;
-        vertices.push_back(tetrahedron[2]);
-        vertices.back().normal = normal;
-        vertices.push_back(tetrahedron[3]);
-        vertices.back().normal = normal;
-
-        normal = glm::vec3();
-        vertices.push_back(tetrahedron[0]);
-        vertices.back().normal = normal;
-        vertices.push_back(tetrahedron[3]);
-        vertices.back().normal = normal;
-        vertices.push_back(tetrahedron[1]);
-        vertices.back().normal = normal;
-
-        normal = glm::vec3();
-        vertices.push_back(tetrahedron[1]);
-        vertices.back().normal = normal;
-        vertices.push_back(tetrahedron[3]);
-        vertices.back().normal = normal;
-        vertices.push_back(tetrahedron[2]);
-        vertices.back().normal = normal;
+// Subtrees of the first split levels are independent and their vertices have a known place in the output,
+// so bands of them are written by the worker threads and the calling thread without locking. threadCount sets
+// the number of bands, 0 uses one per hardware thread.
+std::vector<vertex> createFractalTetrahedronVertices(int depth, unsigned int threadCount = 0)
+{
+    const tetrahedron initialTetrahedron = createInitialTetrahedron();
+
+    // every split tetrahedron is the initial one translated and scaled by one half, so all of them share its face normals
+    glm::vec3 normals[4];
+    for (int face = 0; face < 4; ++face)
+    {
+        const int* corners = fractalTetrahedronFaces[face];
+        normals[face] = calculateNormal(initialTetrahedron[corners[0]].position, initialTetrahedron[corners[1]].position, initialTetrahedron[corners[2]].position);
     }
 
+    // split until there are a few subtrees per thread
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    int splitDepth = 0;
+    while (splitDepth < depth && fractalTetrahedronCount(splitDepth) < (size_t)threadCount * 4)
+        ++splitDepth;
+    std::vector<tetrahedron> subtrees = splitFractalTetrahedron(initialTetrahedron, splitDepth);
+    const size_t subtreeVertices = fractalTetrahedronCount(depth - splitDepth) * 12;
+
+    // add all the tetrahedron faces to the vertex list as triangles
+    std::vector<vertex> vertices(subtrees.size() * subtreeVertices);
+    auto writeSubtrees = [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i)
+        {
+            vertex* out = vertices.data() + i * subtreeVertices;
+            writeFractalTetrahedronFaces(subtrees[i], depth - splitDepth, normals, out);
+        }
+    };
+
+    size_t bands = std::min<size_t>(threadCount, subtrees.size());
+    glframework::runParallel(bands, [&](size_t band) {
+        writeSubtrees(subtrees.size() * band / bands, subtrees.size() * (band + 1) / bands);
+    });
+
     return vertices;
 }
 
+// Split tetrahedra are the initial one scaled by one half per level, so an instance only needs the offset and scale.
+// Child j of offset o and scale s has the offset o + 0.5 * s * B[j] and the scale 0.5 * s, B are the initial corners.
+// The children of parents[i] are written to children[4 * i + j], in the order of splitFractalTetrahedron.
+static void splitFractalInstances(const tetrahedron& initialTetrahedron, const instance* parents, size_t count, instance* children)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        const instance& parent = parents[i];
+        float scale = parent.offset.w * 0.5f;
+        for (int j = 0; j < 4; ++j)
+        {
+            glm::vec3 offset = glm::vec3(parent.offset) + initialTetrahedron[j].position * scale;
+            children[4 * i + j] = instance{ glm::vec4(offset, scale), parent.color + initialTetrahedron[j].color * scale };
+        }
+    }
+}
+
+// Split levels of the instanced fractal tetrahedron, levels[d] holds the 4^d instances of depth d. A deeper level
+// is split from the deepest cached one, shallower levels are returned without any work.
+struct fractalLevelCache
+{
+    tetrahedron initialTetrahedron;
+    std::vector<std::vector<instance>> levels;
+};
+
+const std::vector<instance>& getFractalLevel(fractalLevelCache& cache, int depth)
+{
+    if (cache.levels.empty())
+    {
+        cache.initialTetrahedron = createInitialTetrahedron();
+        cache.levels.push_back(std::vector<instance>(1, instance{ glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), glm::vec3(0.0f) }));
+    }
+    while ((int)cache.levels.size() <= depth)
+    {
+        std::vector<instance> children(cache.levels.back().size() * 4);
+        splitFractalInstances(cache.initialTetrahedron, cache.levels.back().data(), cache.levels.back().size(), children.data());
+        cache.levels.push_back(std::move(children));
+    }
+    return cache.levels[depth];
+}
+
+// Corners of split tetrahedra are points of the lattice sum(i[k] * B[k]) / 2^depth with integer i[k] >= 0 summing
+// to 2^depth, B are the initial corners. Tetrahedra that touch share such a point exactly, so the lattice coordinates
+// weld the vertices without any float comparison. Normals are left zero, draw with the FLAT_NORMALS permutation.
+glframework::mesh createWeldedFractalTetrahedron(int depth)
+{
+    const tetrahedron initialTetrahedron = createInitialTetrahedron();
+    const size_t tetrahedronCount = fractalTetrahedronCount(depth);
+    const uint32_t size = 1u << depth;
+
+    // every split shares one corner between each pair of the 4 new tetrahedra, V(d) = 4 V(d - 1) - 6 = 2 * 4^d + 2
+    const size_t vertexCount = 2 * tetrahedronCount + 2;
+    glframework::mesh result;
+    result.vertices.reserve(vertexCount);
+    result.indices.resize(tetrahedronCount * 12);
+
+    // open addressing table from packed lattice coordinates to vertex index, at most half full
+    size_t capacity = 1;
+    int capacityBits = 0;
+    while (capacity < vertexCount * 2)
+    {
+        capacity *= 2;
+        ++capacityBits;
+    }
+    const uint64_t empty = ~(uint64_t)0;
+    std::vector<uint64_t> keys(capacity, empty);
+    std::vector<GLuint> values(capacity);
+
+    GLuint* indices = result.indices.data();
+    for (size_t t = 0; t < tetrahedronCount; ++t)
+    {
+        // base 4 digits of t from the top select the child at each split, child j moves by half the size towards B[j]
+        uint32_t origin[4] = { 0, 0, 0, 0 };
+        for (int level = 0; level < depth; ++level)
+            origin[(t >> (2 * (depth - 1 - level))) & 3] += size >> (level + 1);
+
+        GLuint corners[4];
+        for (int k = 0; k < 4; ++k)
+        {
+            uint32_t lattice[4] = { origin[0], origin[1], origin[2], origin[3] };
+            lattice[k] += 1;
+
+            // the fourth coordinate follows from the other three
+            uint64_t key = lattice[0] | (uint64_t)lattice[1] << 21 | (uint64_t)lattice[2] << 42;
+            size_t slot = capacityBits ? (size_t)((key * 0x9E3779B97F4A7C15ull) >> (64 - capacityBits)) : 0;
+            while (keys[slot] != empty && keys[slot] != key)
+                slot = (slot + 1) & (capacity - 1);
+            if (keys[slot] == empty)
+            {
+                vertex v{};
+                for (int i = 0; i < 4; ++i)
+                {
+                    float weight = (float)lattice[i] / size;
+                    v.position += initialTetrahedron[i].position * weight;
+                    v.color += initialTetrahedron[i].color * weight;
+                }
+                keys[slot] = key;
+                values[slot] = (GLuint)result.vertices.size();
+                result.vertices.push_back(v);
+            }
+            corners[k] = values[slot];
+        }
+
+        for (int face = 0; face < 4; ++face)
+        {
+            for (int corner = 0; corner < 3; ++corner)
+                *indices++ = corners[fractalTetrahedronFaces[face][corner]];
+        }
+    }
+
+    return result;
+}
+
+// Generates the expanded fractal tetrahedron with transform feedback, so the vertices are created in video memory.
+// Every split level is captured into an instance buffer of its own that is kept for later depth changes, the
+// requested level is expanded into the vertex buffer.
+struct gpuFractalGenerator
+{
+    GLuint splitProgram;
+    GLuint expandProgram;
+    std::vector<GLuint> levelBuffers;       // levelBuffers[d] holds the 4^d instances of depth d
+    std::vector<GLuint> levelVertexArrays;  // read the instances of levelBuffers[d]
+};
+
+static void setFractalUniforms(GLuint program, const tetrahedron& initialTetrahedron)
+{
+    glm::vec3 corners[4], cornerColors[4], faceNormals[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        const int* face = fractalTetrahedronFaces[i];
+        corners[i] = initialTetrahedron[i].position;
+        cornerColors[i] = initialTetrahedron[i].color;
+        faceNormals[i] = calculateNormal(initialTetrahedron[face[0]].position, initialTetrahedron[face[1]].position, initialTetrahedron[face[2]].position);
+    }
+    glUseProgram(program);
+    glUniform3fv(glGetUniformLocation(program, "corners"), 4, glm::value_ptr(corners[0]));
+    glUniform3fv(glGetUniformLocation(program, "cornerColors"), 4, glm::value_ptr(cornerColors[0]));
+    glUniform3fv(glGetUniformLocation(program, "faceNormals"), 4, glm::value_ptr(faceNormals[0]));
+    glUseProgram(0);
+}
+
+void destroyGpuFractalGenerator(gpuFractalGenerator& generator)
+{
+    glDeleteProgram(generator.splitProgram);
+    glDeleteProgram(generator.expandProgram);
+    if (!generator.levelBuffers.empty())
+    {
+        glDeleteVertexArrays((GLsizei)generator.levelVertexArrays.size(), generator.levelVertexArrays.data());
+        glDeleteBuffers((GLsizei)generator.levelBuffers.size(), generator.levelBuffers.data());
+    }
+    generator = gpuFractalGenerator{};
+}
+
+// needs transform feedback and instanced attributes, returns false if the driver has no glVertexAttribDivisor
+bool createGpuFractalGenerator(gpuFractalGenerator& generator)
+{
+    generator = gpuFractalGenerator{};
+    if (!glVertexAttribDivisor)
+        return false;
+
+    const char* splitVaryings[] = { "childOffset", "childColor" };
+    const char* expandVaryings[] = { "position", "texcoord", "normal", "color" };
+    generator.splitProgram = glframework::loadTransformFeedbackProgram("shaders/fractal_split.vert", splitVaryings, 2);
+    generator.expandProgram = glframework::loadTransformFeedbackProgram("shaders/fractal_expand.vert", expandVaryings, 4);
+    if (!generator.splitProgram || !generator.expandProgram)
+    {
+        destroyGpuFractalGenerator(generator);
+        return false;
+    }
+
+    const tetrahedron initialTetrahedron = createInitialTetrahedron();
+    setFractalUniforms(generator.splitProgram, initialTetrahedron);
+    setFractalUniforms(generator.expandProgram, initialTetrahedron);
+    return true;
+}
+
+// creates the buffer of the next level, the instance layout is captured by the split shader and read back as instance attributes
+static void addFractalLevel(gpuFractalGenerator& generator)
+{
+    const size_t instanceCount = fractalTetrahedronCount((int)generator.levelBuffers.size());
+    GLuint buffer, vertexArray;
+    glGenBuffers(1, &buffer);
+    glGenVertexArrays(1, &vertexArray);
+    glBindVertexArray(vertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, instanceCount * sizeof(instance), NULL, GL_DYNAMIC_COPY);
+    glEnableVertexAttribArray(4);
+    glEnableVertexAttribArray(5);
+    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(instance), (void*)offsetof(instance, offset));
+    glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(instance), (void*)offsetof(instance, color));
+    glVertexAttribDivisor(4, 1);
+    glVertexAttribDivisor(5, 1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    generator.levelBuffers.push_back(buffer);
+    generator.levelVertexArrays.push_back(vertexArray);
+}
+
+// Writes the vertices of createFractalTetrahedronVertices(depth) into target. Only levels deeper than the cached
+// ones are split, then the level is expanded. An existing target keeps its vertex array object, its vertex buffer
+// is orphaned when the vertex count changes.
+void generateFractalTetrahedronGPU(gpuFractalGenerator& generator, int depth, glframework::vao& target)
+{
+    const GLuint vertexCount = (GLuint)(fractalTetrahedronCount(depth) * 12);
+    if (!target.id)
+    {
+        target = glframework::createVertexArrayObject(NULL, vertexCount);
+    }
+    else if (target.vertexCount != vertexCount)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, target.vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(vertex), NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        target.vertexCount = vertexCount;
+    }
+
+    if (generator.levelBuffers.empty())
+    {
+        const instance initialInstance{ glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), glm::vec3(0.0f) };
+        addFractalLevel(generator);
+        glBindBuffer(GL_ARRAY_BUFFER, generator.levelBuffers[0]);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(instance), &initialInstance);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // transform feedback captures the instances in order, so child j of instance i lands at 4 * i + j
+    glEnable(GL_RASTERIZER_DISCARD);
+    glUseProgram(generator.splitProgram);
+    for (int level = (int)generator.levelBuffers.size() - 1; level < depth; ++level)
+    {
+        addFractalLevel(generator);
+        glBindVertexArray(generator.levelVertexArrays[level]);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, generator.levelBuffers[level + 1]);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArraysInstanced(GL_POINTS, 0, 4, (GLsizei)fractalTetrahedronCount(level));
+        glEndTransformFeedback();
+    }
+
+    glUseProgram(generator.expandProgram);
+    glBindVertexArray(generator.levelVertexArrays[depth]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, target.vbo);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArraysInstanced(GL_POINTS, 0, 12, (GLsizei)fractalTetrahedronCount(depth));
+    glEndTransformFeedback();
+
+    // cleanup
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glDisable(GL_RASTERIZER_DISCARD);
+}
+
+// Mesh rebuilt on a worker thread whenever another depth or vertex layout is requested. One build runs at a time and
+// its result replaces the buffers of the same vertex array object, so requesting the current mesh every frame costs nothing.
+struct fractalMeshBuilder
+{
+    std::function<glframework::mesh(int)> build;
+    glframework::vao vertexArray;
+    int builtDepth;
+    int builtLayout;
+    bool building;
+};
+
+// the vertex layouts the fractal meshes can be stored in, indexed by the layout argument of requestFractalMesh
+const glframework::vertexLayout fractalVertexLayouts[] = {
+    glframework::floatVertexLayout, glframework::compactVertexLayout, glframework::quantizedVertexLayout
+};
+const char* const fractalVertexLayoutNames[] = { "Float", "Compact", "Quantized" };
+
+void requestFractalMesh(std::shared_ptr<fractalMeshBuilder> builder, int depth, int layout)
+{
+    if (builder->building || (builder->builtDepth == depth && builder->builtLayout == layout))
+        return;
+    builder->building = true;
+    glframework::queueJob([builder, depth, layout]() {
+        std::shared_ptr<glframework::mesh> built = std::make_shared<glframework::mesh>(builder->build(depth));
+        glframework::queueUpload([builder, depth, layout, built]() {
+            glframework::updateVertexArrayObject(builder->vertexArray, built->vertices, built->indices, fractalVertexLayouts[layout]);
+            builder->builtDepth = depth;
+            builder->builtLayout = layout;
+            builder->building = false;
+        });
+    });
+}
+
+std::shared_ptr<fractalMeshBuilder> createFractalMeshBuilder(std::function<glframework::mesh(int)> build)
+{
+    std::shared_ptr<fractalMeshBuilder> builder = std::make_shared<fractalMeshBuilder>();
+    builder->build = build;
+    builder->vertexArray = glframework::vao{};
+    builder->builtDepth = -1;
+    builder->builtLayout = -1;
+    builder->building = false;
+    return builder;
+}
+
+// the verification programs in verify/ build this file for its geometry code and bring their own main()
+#if !defined(GLFRAMEWORK_NO_MAIN)
 int main()
 {
     if (!glframework::init("Interaktive Computergrafik 1"))
         return 1;
 
-    // load shader
-    GLuint shaderProgram = glframework::loadShaderProgram("shaders/default.vert", "shaders/light.frag");
-    GLint mvpLocation = glGetUniformLocation(shaderProgram, "MVP");
-
-    // create the cube mesh
-    auto cubeVertices = createCubeVertices();
-    auto cubaVAO = glframework::createVertexArrayObject(cubeVertices);
+    // load the lit and unlit shader permutations for plain, instanced and welded meshes during the first frames,
+    // one upload each so the upload budget can spread them, and reload them whenever one of their files is saved
+    glframework::shaderReflection* shaderPrograms[6] = {};
+    const glframework::shaderDefines permutations[6] = {
+        {}, { "UNLIT" }, { "INSTANCED" }, { "INSTANCED", "UNLIT" }, { "FLAT_NORMALS" }, { "FLAT_NORMALS", "UNLIT" }
+    };
+    for (int i = 0; i < 6; ++i)
+    {
+        glframework::shaderDefines defines = permutations[i];
+        glframework::queueUpload([&shaderPrograms, defines, i]() {
+            glframework::loadShaderProgramWatched("shaders/default.vert", "shaders/light.frag", defines, [&shaderPrograms, i](GLuint program) {
+                shaderPrograms[i] = glframework::reflectProgram(program);
+            });
+        });
+    }
+    const uint32_t mvpName = glframework::internString("MVP");
+
+    // pack all primitives into one buffer, meshes are drawn as soon as they are uploaded
+    std::vector<primitiveType> primitiveTypes;
+    for (int type = 0; type < primitiveTypeCount; ++type)
+        primitiveTypes.push_back((primitiveType)type);
+    primitiveBuffer primitives{};
+    createPrimitiveBufferAsync(primitiveTypes, 16, [&](primitiveBuffer created) { primitives = created; });
+
+    // The fractal tetrahedron follows the depth slider in each of its variants, a variant is only brought to the
+    // selected depth while it is displayed. The expanded vertices are generated on the GPU, or rebuilt on the CPU if
+    // transform feedback of instances isn't available. The generator programs are built by an upload, until then
+    // the expanded variant isn't drawn.
+    int fractalDepth = 6;
+    int fractalLayout = 1;
+    double fractalUpdateTime = 0.0;
+    gpuFractalGenerator fractalGenerator{};
+    glframework::vao tetrahedronVAO{};
+    int tetrahedronDepth = -1;
+    enum { generatorPending, generatorReady, generatorUnsupported };
+    int generatorState = generatorPending;
+    glframework::queueUpload([&]() {
+        generatorState = createGpuFractalGenerator(fractalGenerator) ? generatorReady : generatorUnsupported;
+    });
+    std::shared_ptr<fractalMeshBuilder> expandedBuilder = createFractalMeshBuilder([](int depth) {
+        glframework::mesh expanded;
+        expanded.vertices = createFractalTetrahedronVertices(depth);
+        return expanded;
+    });
+
+    // the same tetrahedron as one base tetrahedron drawn once per split tetrahedron, split levels are cached
+    fractalLevelCache fractalLevels;
+    glframework::vao tetrahedronInstancesVAO{};
+    int tetrahedronInstancesDepth = -1;
+    const bool instancingSupported = glVertexAttribDivisor != NULL;
+    if (instancingSupported)
+    {
+        glframework::queueUpload([&]() {
+            std::vector<vertex> vertices = createFractalTetrahedronVertices(0);
+            const std::vector<instance>& instances = getFractalLevel(fractalLevels, 0);
+            tetrahedronInstancesVAO = glframework::createInstancedVertexArrayObject(vertices.data(), vertices.size(), instances.data(), instances.size());
+            tetrahedronInstancesDepth = 0;
+        });
+    }
 
-    // create the tetrahedron mesh
-    auto tetrahedronVertices = createFractalTetrahedronVertices();
-    auto tetrahedronVAO = glframework::createVertexArrayObject(tetrahedronVertices);
+    // the same tetrahedron with every shared corner stored once
+    std::shared_ptr<fractalMeshBuilder> weldedBuilder = createFractalMeshBuilder(createWeldedFractalTetrahedron);
 
     // set rendering parameters
     glEnable(GL_CULL_FACE);
@@ -338,54 +1606,129 @@ int main()
     glFrontFace(GL_CCW);
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LESS);
-    int drawVAO = 0;
+    int drawVAO = primitiveCube;
+    const int drawTetrahedron = primitiveTypeCount;
+    bool lighting = true;
+    enum { tetrahedronExpanded, tetrahedronInstanced, tetrahedronWelded };
+    int tetrahedronMode = instancingSupported ? tetrahedronInstanced : tetrahedronExpanded;
     
     // main rendering loop
     while (glframework::isRunning())
     {
         glframework::beginFrame();
+        const bool gpuFractal = generatorState == generatorReady;
+        const bool cpuFractal = generatorState == generatorUnsupported;
 
         // draw user interface
         ImGui::SetNextWindowPos(ImVec2(10, 10), ImGuiCond_Always);
-        ImGui::SetNextWindowSize(ImVec2(200, 100), ImGuiCond_Always);
+        ImGui::SetNextWindowSize(ImVec2(200, 370), ImGuiCond_Always);
         ImGui::Begin("Rendering Parameters");
-        ImGui::RadioButton("Draw Cube", &drawVAO, 0);
-        ImGui::RadioButton("Draw Tetrahedron", &drawVAO, 1);
+        for (int type = 0; type < primitiveTypeCount; ++type)
+            ImGui::RadioButton((std::string("Draw ") + primitiveNames[type]).c_str(), &drawVAO, type);
+        ImGui::RadioButton("Draw Tetrahedron", &drawVAO, drawTetrahedron);
+        ImGui::Checkbox("Lighting", &lighting);
+        ImGui::RadioButton("Expanded", &tetrahedronMode, tetrahedronExpanded);
+        if (instancingSupported)
+        {
+            ImGui::SameLine();
+            ImGui::RadioButton("Instanced", &tetrahedronMode, tetrahedronInstanced);
+        }
+        ImGui::RadioButton("Welded", &tetrahedronMode, tetrahedronWelded);
+        ImGui::SliderInt("Depth", &fractalDepth, 0, 9);
+        // only the fractal meshes built on the CPU are stored in the selected layout, the instanced and GPU generated
+        // vertices are always floats
+        bool layoutApplies = drawVAO == drawTetrahedron &&
+            (tetrahedronMode == tetrahedronWelded || (tetrahedronMode == tetrahedronExpanded && cpuFractal));
+        ImGui::BeginDisabled(!layoutApplies);
+        ImGui::Combo("Vertices", &fractalLayout, fractalVertexLayoutNames, 3);
+        ImGui::EndDisabled();
+        ImGui::Text("Depth change: %.2f ms", fractalUpdateTime * 1000.0);
+        glframework::uniformStatistics uniformUploads = glframework::getUniformStatistics();
+        ImGui::Text("Uniforms issued: %llu", (unsigned long long)uniformUploads.issued);
+        ImGui::Text("Uniforms skipped: %llu", (unsigned long long)uniformUploads.skipped);
         ImGui::End();
 
+        // bring the displayed fractal tetrahedron to the selected depth once its buffers exist, the instanced and GPU
+        // variants update in place
+        double updateStart = glfwGetTime();
+        bool updated = false;
+        if (drawVAO == drawTetrahedron && tetrahedronMode == tetrahedronInstanced && tetrahedronInstancesVAO.id && tetrahedronInstancesDepth != fractalDepth)
+        {
+            const std::vector<instance>& instances = getFractalLevel(fractalLevels, fractalDepth);
+            glframework::updateInstances(tetrahedronInstancesVAO, instances.data(), instances.size());
+            tetrahedronInstancesDepth = fractalDepth;
+            updated = true;
+        }
+        else if (drawVAO == drawTetrahedron && tetrahedronMode == tetrahedronExpanded && gpuFractal && tetrahedronDepth != fractalDepth)
+        {
+            generateFractalTetrahedronGPU(fractalGenerator, fractalDepth, tetrahedronVAO);
+            tetrahedronDepth = fractalDepth;
+            updated = true;
+        }
+        else if (drawVAO == drawTetrahedron && tetrahedronMode == tetrahedronExpanded && cpuFractal)
+        {
+            requestFractalMesh(expandedBuilder, fractalDepth, fractalLayout);
+        }
+        else if (drawVAO == drawTetrahedron && tetrahedronMode == tetrahedronWelded)
+        {
+            requestFractalMesh(weldedBuilder, fractalDepth, fractalLayout);
+        }
+        if (updated)
+            fractalUpdateTime = glfwGetTime() - updateStart;
+
         // update rendered image size
         int width, height;
         glframework::getWindowSize(&width, &height);
         glViewport(0, 0, width, height);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // set shader for rendering
-        glUseProgram(shaderProgram);        
+        // set shader for rendering, the instanced and welded tetrahedra need their own permutations
+        int mode = drawVAO == drawTetrahedron ? tetrahedronMode : tetrahedronExpanded;
+        glframework::shaderReflection* shaderProgram = shaderPrograms[(lighting ? 0 : 1) + mode * 2];
+        glUseProgram(shaderProgram ? shaderProgram->program : 0);
         
-        // calculate and set model view projection matrix
+        // calculate and set model view projection matrix, quantized positions are scaled back by the model matrix
         glm::mat4 m = glm::mat4(1.0f);
+        if (drawVAO == drawTetrahedron && mode == tetrahedronWelded)
+            m = glframework::getPositionTransform(weldedBuilder->vertexArray);
+        else if (drawVAO == drawTetrahedron && mode == tetrahedronExpanded && cpuFractal)
+            m = glframework::getPositionTransform(expandedBuilder->vertexArray);
         glm::mat4 v = glframework::getCamera();
         glm::mat4 p = glm::perspective(glm::radians(30.0f), (float)width / (float)height, 0.1f, 10.0f);
         glm::mat4 mvp = p * v * m;
-        glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, glm::value_ptr(mvp));
+        if (shaderProgram)
+            glframework::setUniform(*shaderProgram, mvpName, mvp);
         
-        // draw the selected vertex array object
-        if (drawVAO == 0)
+        // draw the selected vertex array object once it has been loaded
+        if (drawVAO < primitiveTypeCount && shaderProgram && primitives.vertexArray.id)
+        {
+            // draw the selected primitive from the shared buffer
+            glBindVertexArray(primitives.vertexArray.id);
+            drawPrimitive(primitives, drawVAO);
+        }
+        else if (drawVAO == drawTetrahedron && mode == tetrahedronInstanced && shaderProgram && tetrahedronInstancesVAO.id)
+        {
+            // draw fractal tetrahedron as instances of the initial tetrahedron
+            glframework::drawVertexArrayObject(tetrahedronInstancesVAO);
+        }
+        else if (drawVAO == drawTetrahedron && mode == tetrahedronWelded && shaderProgram && weldedBuilder->vertexArray.id)
         {
-            // draw cube
-            glBindVertexArray(cubaVAO.id);
-            glDrawArrays(GL_TRIANGLES, 0, 36); // TODO: Set the correct number of vertices to be rendered
+            // draw fractal tetrahedron from shared vertices
+            glframework::drawVertexArrayObject(weldedBuilder->vertexArray);
         }
-        else if (drawVAO == 1)
+        else if (drawVAO == drawTetrahedron && mode == tetrahedronExpanded && shaderProgram)
         {
             // draw fractal tetrahedron
-            glBindVertexArray(tetrahedronVAO.id);
-            glDrawArrays(GL_TRIANGLES, 0, tetrahedronVAO.vertexCount); // TODO: Set the correct number of vertices to be rendered
+            const glframework::vao& expandedVAO = gpuFractal ? tetrahedronVAO : expandedBuilder->vertexArray;
+            if (expandedVAO.id)
+                glframework::drawVertexArrayObject(expandedVAO);
         }
 
         glframework::endFrame();
     }
 
+    destroyGpuFractalGenerator(fractalGenerator);
     glframework::destroy();
     return 0;
 }
+#endif
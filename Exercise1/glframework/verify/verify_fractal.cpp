@@ -0,0 +1,66 @@
+// Compares the fractal tetrahedron generated on the GPU with transform feedback with the CPU generated one of
+// createFractalTetrahedronVertices. Runs headless on Mesa llvmpipe, e.g. from the build directory:
+//   LIBGL_ALWAYS_SOFTWARE=1 xvfb-run ./verify_fractal [max depth]
+// Returns 0 if the vertices of all depths match.
+
+#define GLFRAMEWORK_NO_MAIN
+#include "../src/main.cpp"
+
+// Compares the GPU vertices with createFractalTetrahedronVertices for depths 0 to maxDepth and prints the largest
+// difference, the two paths round differently so they match up to a small tolerance.
+bool verifyFractalTetrahedronGPU(gpuFractalGenerator& generator, int maxDepth)
+{
+    bool passed = true;
+    glframework::vao generated{};
+    for (int depth = 0; depth <= maxDepth; ++depth)
+    {
+        double start = glfwGetTime();
+        generateFractalTetrahedronGPU(generator, depth, generated);
+        glFinish();
+        double gpuTime = glfwGetTime() - start;
+
+        start = glfwGetTime();
+        std::vector<vertex> expected = createFractalTetrahedronVertices(depth);
+        double cpuTime = glfwGetTime() - start;
+
+        std::vector<vertex> vertices(generated.vertexCount);
+        glBindBuffer(GL_ARRAY_BUFFER, generated.vbo);
+        glGetBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(vertex), vertices.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        float maxError = 0.0f;
+        bool sizeMatches = vertices.size() == expected.size();
+        for (size_t i = 0; sizeMatches && i < vertices.size(); ++i)
+        {
+            const float* a = glm::value_ptr(vertices[i].position);
+            const float* b = glm::value_ptr(expected[i].position);
+            for (size_t c = 0; c < sizeof(vertex) / sizeof(float); ++c)
+                maxError = std::max(maxError, std::abs(a[c] - b[c]));
+        }
+
+        bool matches = sizeMatches && maxError < 1e-5f;
+        passed = passed && matches;
+        printf("Fractal depth %d: %zu vertices, GPU %.2f ms, CPU %.2f ms, max difference %g %s\n",
+            depth, expected.size(), gpuTime * 1000.0, cpuTime * 1000.0, maxError, matches ? "ok" : "FAILED");
+    }
+
+    glDeleteVertexArrays(1, &generated.id);
+    glDeleteBuffers(1, &generated.vbo);
+    return passed;
+}
+
+int main(int argc, char** argv)
+{
+    if (!glframework::init("Verify Fractal Tetrahedron"))
+        return 1;
+
+    int maxDepth = argc > 1 ? atoi(argv[1]) : 8;
+    gpuFractalGenerator generator{};
+    bool supported = createGpuFractalGenerator(generator);
+    if (!supported)
+        printf("Transform feedback of instances isn't available\n");
+    bool passed = supported && verifyFractalTetrahedronGPU(generator, maxDepth);
+    destroyGpuFractalGenerator(generator);
+    glframework::destroy();
+    return passed ? 0 : 1;
+}
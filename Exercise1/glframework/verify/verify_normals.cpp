@@ -0,0 +1,105 @@
+// Compares the batched flat and smooth normals of vertexstreams.h with calculateNormal on the fractal tetrahedron.
+// Needs no OpenGL context, e.g. from the build directory:
+//   ./verify_normals [depth]
+// Returns 0 if all normals match.
+
+#define GLFRAMEWORK_NO_MAIN
+#include "../src/main.cpp"
+
+#include <chrono>
+
+static double getSeconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// largest difference between the normals of the streams and the reference normals
+static float maxNormalDifference(const vertexStreams& streams, const std::vector<glm::vec3>& expected)
+{
+    float maxError = 0.0f;
+    for (int c = 0; c < 3; ++c)
+    {
+        const float* normals = vertexStreamsComponent(streams, vertexNormalX + c);
+        for (size_t i = 0; i < expected.size(); ++i)
+            maxError = std::max(maxError, std::abs(normals[i] - expected[i][c]));
+    }
+    return maxError;
+}
+
+// Compares the batched flat and smooth normals with calculateNormal on the fractal tetrahedron at the given depth,
+// as triangle soup and as welded mesh, and prints the time of both on one and on all hardware threads.
+bool verifyBatchedNormals(int depth)
+{
+    bool passed = true;
+    const float tolerance = 1e-5f;
+
+    // flat normals of the triangle soup
+    std::vector<vertex> soup = createFractalTetrahedronVertices(depth);
+    vertexStreams streams{};
+    glframework::toVertexStreams(soup.data(), soup.size(), streams);
+    double start = getSeconds();
+    std::vector<glm::vec3> expected(soup.size());
+    for (size_t i = 0; i + 2 < soup.size(); i += 3)
+        expected[i] = expected[i + 1] = expected[i + 2] = calculateNormal(soup[i].position, soup[i + 1].position, soup[i + 2].position);
+    double scalarTime = getSeconds() - start;
+    double times[2];
+    for (int run = 0; run < 2; ++run)
+    {
+        start = getSeconds();
+        vertexStreamsFlatNormals(streams, run == 0 ? 1 : 0);
+        times[run] = getSeconds() - start;
+    }
+    float maxError = maxNormalDifference(streams, expected);
+    passed = passed && maxError < tolerance;
+    printf("Flat normals of %zu triangles: calculateNormal %.2f ms, batched %.2f ms, all threads %.2f ms, max difference %g %s\n",
+        soup.size() / 3, scalarTime * 1000.0, times[0] * 1000.0, times[1] * 1000.0,
+        maxError, maxError < tolerance ? "ok" : "FAILED");
+
+    // smooth normals of the welded mesh, the reference weights calculateNormal by area or angle per corner
+    glframework::mesh welded = createWeldedFractalTetrahedron(depth);
+    glframework::toVertexStreams(welded.vertices.data(), welded.vertices.size(), streams);
+    const char* weightingNames[2] = { "area", "angle" };
+    for (int weighting = vertexNormalsArea; weighting <= vertexNormalsAngle; ++weighting)
+    {
+        start = getSeconds();
+        std::vector<glm::vec3> sums(welded.vertices.size(), glm::vec3(0.0f));
+        for (size_t i = 0; i + 2 < welded.indices.size(); i += 3)
+        {
+            glm::vec3 p[3];
+            for (int k = 0; k < 3; ++k)
+                p[k] = welded.vertices[welded.indices[i + k]].position;
+            glm::vec3 normal = calculateNormal(p[0], p[1], p[2]);
+            for (int k = 0; k < 3; ++k)
+            {
+                glm::vec3 u = p[(k + 1) % 3] - p[k], v = p[(k + 2) % 3] - p[k];
+                float weight = weighting == vertexNormalsArea ? 0.5f * glm::length(glm::cross(u, v)) : std::acos(glm::dot(glm::normalize(u), glm::normalize(v)));
+                sums[welded.indices[i + k]] += normal * weight;
+            }
+        }
+        expected.resize(sums.size());
+        for (size_t i = 0; i < sums.size(); ++i)
+            expected[i] = glm::normalize(sums[i]);
+        scalarTime = getSeconds() - start;
+
+        for (int run = 0; run < 2; ++run)
+        {
+            start = getSeconds();
+            vertexStreamsSmoothNormals(streams, welded.indices.data(), welded.indices.size(), (vertexNormalWeighting)weighting, run == 0 ? 1 : 0);
+            times[run] = getSeconds() - start;
+        }
+        maxError = maxNormalDifference(streams, expected);
+        passed = passed && maxError < tolerance;
+        printf("Smooth %s weighted normals of %zu vertices: calculateNormal %.2f ms, batched %.2f ms, all threads %.2f ms, max difference %g %s\n",
+            weightingNames[weighting], welded.vertices.size(), scalarTime * 1000.0, times[0] * 1000.0, times[1] * 1000.0,
+            maxError, maxError < tolerance ? "ok" : "FAILED");
+    }
+
+    vertexStreamsRelease(streams);
+    return passed;
+}
+
+int main(int argc, char** argv)
+{
+    int depth = argc > 1 ? atoi(argv[1]) : 8;
+    return verifyBatchedNormals(depth) ? 0 : 1;
+}